@@ -0,0 +1,212 @@
+#include "arena.h"
+
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "operations.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+/// Rounds a size up to the arena alignment.
+/// @param size Size to be rounded.
+/// @return Rounded size.
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+/// Gets the size of the blocks of a class.
+/// @param class Index of the class.
+/// @return Size of the class, in bytes.
+static size_t class_size(size_t class) {
+  if (class < 8) {
+    return 16 * (class + 1);
+  }
+
+  size_t base = (size_t)128 << ((class - 8) / 4);
+  return base + ((class - 8) % 4 + 1) * (base / 4);
+}
+
+/// Finds the smallest class whose blocks can hold a size.
+/// @param size Number of bytes, at most ARENA_MAX_CLASS.
+/// @return Index of the class.
+static size_t class_above(size_t size) {
+  if (size <= 128) {
+    return size == 0 ? 0 : (size - 1) / 16;
+  }
+
+  size_t base = 128;
+  size_t class = 8;
+  while (2 * base < size) {
+    base *= 2;
+    class += 4;
+  }
+
+  size_t step = base / 4;
+  return class + (size - base + step - 1) / step - 1;
+}
+
+/// Carves a block from the newest chunk, adding a chunk if it is full.
+/// @note Must be called with the arena locked.
+/// @param arena Arena to allocate from.
+/// @param size Number of bytes, already aligned.
+/// @return Pointer to the block, NULL on failure.
+static void *carve(struct Arena *arena, size_t size) {
+  struct ArenaChunk *chunk = arena->chunks;
+
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    if (arena->shared) {
+      fprintf(stderr, "Shared arena is full\n");
+      return NULL;
+    }
+
+    size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+    chunk = malloc(align_up(sizeof(struct ArenaChunk)) + chunk_size);
+    if (chunk == NULL) {
+      return NULL;
+    }
+
+    chunk->next = arena->chunks;
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    arena->chunks = chunk;
+    arena->bytes_reserved += chunk_size;
+  }
+
+  void *ptr = (char *)chunk + align_up(sizeof(struct ArenaChunk)) + chunk->used;
+  chunk->used += size;
+  return ptr;
+}
+
+struct Arena *arena_create(size_t size, int shared) {
+  struct Arena *arena;
+
+  if (shared) {
+    // The shared memory object is unlinked right away, the mapping keeps it alive.
+    char name[64];
+    snprintf(name, sizeof(name), "/ems-arena-%ld", (long)getpid());
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+      fprintf(stderr, "Failed to create arena\n");
+      return NULL;
+    }
+    shm_unlink(name);
+
+    // The object is sparse: pages are only backed when they are first written.
+    if (ftruncate(fd, (off_t)size) == -1) {
+      fprintf(stderr, "Failed to size arena\n");
+      close(fd);
+      return NULL;
+    }
+
+    arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (arena == MAP_FAILED) {
+      fprintf(stderr, "Failed to map arena\n");
+      return NULL;
+    }
+
+    // The rest of the mapping is the only chunk of the arena.
+    size_t header = align_up(sizeof(struct Arena));
+    struct ArenaChunk *chunk = (struct ArenaChunk *)((char *)arena + header);
+    chunk->next = NULL;
+    chunk->size = size - header - align_up(sizeof(struct ArenaChunk));
+    chunk->used = 0;
+
+    arena->chunks = chunk;
+    arena->size = size;
+    arena->bytes_reserved = size;
+    safe_mutex_init_shared(&arena->lock);
+  } else {
+    arena = malloc(sizeof(struct Arena));
+    if (arena == NULL) {
+      fprintf(stderr, "Failed to create arena\n");
+      return NULL;
+    }
+
+    arena->chunks = NULL;
+    arena->size = 0;
+    arena->bytes_reserved = 0;
+    safe_mutex_init(&arena->lock);
+  }
+
+  arena->shared = shared;
+  arena->num_allocs = 0;
+  for (size_t i = 0; i < ARENA_NUM_CLASSES; i++) {
+    arena->free_lists[i] = NULL;
+  }
+
+  return arena;
+}
+
+void arena_destroy(struct Arena *arena) {
+  if (arena == NULL) {
+    return;
+  }
+
+  safe_mutex_destroy(&arena->lock);
+
+  if (arena->shared) {
+    munmap(arena, arena->size);
+    return;
+  }
+
+  struct ArenaChunk *chunk = arena->chunks;
+  while (chunk != NULL) {
+    struct ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(arena);
+}
+
+void *arena_alloc(struct Arena *arena, size_t size) {
+  size = align_up(size > 0 ? size : 1);
+  void *ptr = NULL;
+
+  safe_mutex_lock(&arena->lock);
+  if (size <= ARENA_MAX_CLASS) {
+    // Every block in this list is at least as large as the class, so it fits.
+    size_t class = class_above(size);
+    if (arena->free_lists[class] != NULL) {
+      // Freed blocks store the next free block in their first bytes.
+      ptr = arena->free_lists[class];
+      arena->free_lists[class] = *(void **)ptr;
+    }
+  }
+
+  if (ptr == NULL) {
+    ptr = carve(arena, size);
+  }
+
+  if (ptr != NULL) {
+    arena->num_allocs++;
+  }
+  safe_mutex_unlock(&arena->lock);
+
+  return ptr;
+}
+
+void arena_free(struct Arena *arena, void *ptr, size_t size) {
+  size = align_up(size > 0 ? size : 1);
+  if (ptr == NULL || size > ARENA_MAX_CLASS) {
+    return;
+  }
+
+  // The block goes to the largest class it can hold.
+  size_t class = class_above(size);
+  if (class_size(class) > size) {
+    class--;
+  }
+
+  safe_mutex_lock(&arena->lock);
+  *(void **)ptr = arena->free_lists[class];
+  arena->free_lists[class] = ptr;
+  safe_mutex_unlock(&arena->lock);
+}
@@ -0,0 +1,60 @@
+#ifndef EMS_ARENA_H
+#define EMS_ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/// Size classes are multiples of 16 bytes up to 128 bytes, then four classes
+/// per power of two up to ARENA_MAX_CLASS bytes.
+#define ARENA_MAX_CLASS 32768
+#define ARENA_NUM_CLASSES 40
+
+/// Block of memory that allocations are carved from.
+struct ArenaChunk {
+  struct ArenaChunk *next; /// Previous chunk of the arena.
+  size_t size;             /// Usable bytes after this header.
+  size_t used;             /// Bytes already handed out.
+};
+
+/// Size-class slab allocator. Blocks are carved from the chunks with their
+/// exact (aligned) size. Freed blocks up to ARENA_MAX_CLASS bytes are recycled
+/// through per-class free lists, larger ones are only released when the arena
+/// is destroyed.
+/// A shared arena is one fixed mapping created before fork, with the arena
+/// header at its start, so every child allocates from the same state. A
+/// private arena grows by adding chunks.
+struct Arena {
+  pthread_mutex_t lock;                  /// Protects the chunks and the free lists.
+  int shared;                            /// 1 if the arena is shared with forked children.
+  size_t size;                           /// Size of the mapping of a shared arena.
+  struct ArenaChunk *chunks;             /// Chunks, the newest first.
+  void *free_lists[ARENA_NUM_CLASSES];   /// Freed blocks of each size class.
+  size_t num_allocs;                     /// Number of blocks handed out.
+  size_t bytes_reserved;                 /// Bytes taken from the system for chunks.
+};
+
+/// Creates a new arena.
+/// @param size Size of a shared arena, which cannot grow. Pages are only
+/// backed when they are first used. Ignored for private arenas.
+/// @param shared 1 to share the arena with forked children, 0 otherwise.
+/// @return Newly created arena, NULL on failure.
+struct Arena *arena_create(size_t size, int shared);
+
+/// Releases everything allocated from an arena, in one call.
+/// @param arena Arena to be destroyed, may be NULL.
+void arena_destroy(struct Arena *arena);
+
+/// Allocates memory from an arena.
+/// @param arena Arena to allocate from.
+/// @param size Number of bytes.
+/// @return Pointer to the memory, aligned for any type, NULL on failure.
+void *arena_alloc(struct Arena *arena, size_t size);
+
+/// Gives a block back to a free list, so that it can be reused. Blocks larger
+/// than ARENA_MAX_CLASS are kept until the arena is destroyed.
+/// @param arena Arena the block was allocated from.
+/// @param ptr Block to be freed, may be NULL.
+/// @param size Size that the block was allocated with.
+void arena_free(struct Arena *arena, void *ptr, size_t size);
+
+#endif // EMS_ARENA_H
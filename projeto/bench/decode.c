@@ -0,0 +1,195 @@
+/// Parse throughput of the text and the compiled .jobs formats: one generated
+/// workload is written as a .jobs file and compiled with jobsbin_compile, then
+/// both are mapped and every command is decoded like the threads do, one
+/// claimed line at a time. Reports the time to map and index each file and to
+/// decode its commands.
+/// @note The commands are decoded but not run.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jobsbin.h"
+#include "jobsmap.h"
+#include "parser.h"
+#include "reader.h"
+
+/// Events created at the top of the file and used by its commands.
+#define NUM_EVENTS 1000
+
+/// Gets the current time.
+/// @return Nanoseconds of the monotonic clock.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/// Writes at least the given number of bytes of commands: RESERVEs of 1 to 8
+/// seats, then SHOW, RESERVE_BEST, LIST, WAIT and BARRIER.
+/// @return 0 on success, 1 on failure.
+static int generate(FILE *file, size_t bytes) {
+  char line[256];
+  size_t written = 0;
+
+  for (unsigned int e = 1; e <= NUM_EVENTS; e++) {
+    written += (size_t)fprintf(file, "CREATE %u 100 100\n", e);
+  }
+
+  uint64_t state = 1;
+  while (written < bytes) {
+    state = state * 6364136223846793005 + 1442695040888963407;
+    unsigned int kind = (unsigned int)(state >> 33) % 100;
+    unsigned int event = (unsigned int)(state >> 17) % NUM_EVENTS + 1;
+    int n;
+
+    if (kind < 60) {
+      unsigned int num_seats = (unsigned int)(state >> 45) % 8 + 1;
+      n = snprintf(line, sizeof(line), "RESERVE %u [", event);
+      for (unsigned int s = 0; s < num_seats; s++) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        n += snprintf(line + n, sizeof(line) - (size_t)n, "%s(%u,%u)", s > 0 ? " " : "",
+                      (unsigned int)(state >> 33) % 100 + 1, (unsigned int)(state >> 17) % 100 + 1);
+      }
+      n += snprintf(line + n, sizeof(line) - (size_t)n, "]\n");
+    } else if (kind < 75) {
+      n = snprintf(line, sizeof(line), "SHOW %u\n", event);
+    } else if (kind < 85) {
+      n = snprintf(line, sizeof(line), "RESERVE_BEST %u %u %u\n", event, kind % 8 + 1,
+                   (unsigned int)(state >> 45) % 100);
+    } else if (kind < 90) {
+      n = snprintf(line, sizeof(line), "LIST\n");
+    } else if (kind < 97) {
+      n = snprintf(line, sizeof(line), "WAIT %u\n", kind % 10);
+    } else {
+      n = snprintf(line, sizeof(line), "BARRIER\n");
+    }
+
+    written += fwrite(line, 1, (size_t)n, file);
+  }
+
+  return fflush(file) != 0 || ferror(file);
+}
+
+/// Decodes the command of one line, like run_command before it runs it.
+/// @return 1 if the command was valid, 0 otherwise.
+static int decode(const struct JobsDecoder *decoder, struct Reader *reader,
+                  struct Coords *coords) {
+  unsigned int event_id, delay, thread_id;
+  size_t rows, cols, num_seats, row_hint;
+
+  switch (decoder->get_next(reader)) {
+  case CMD_CREATE:
+    return decoder->parse_create(reader, &event_id, &rows, &cols) == 0;
+  case CMD_RESERVE:
+    return decoder->parse_reserve(reader, &event_id, coords) > 0;
+  case CMD_RESERVE_BEST:
+    return decoder->parse_reserve_best(reader, &event_id, &num_seats, &row_hint) == 0;
+  case CMD_SHOW:
+    return decoder->parse_show(reader, &event_id) == 0;
+  case CMD_STATS:
+    return decoder->parse_stats(reader, &event_id) != -1;
+  case CMD_WAIT:
+    return decoder->parse_wait(reader, &delay, &thread_id) != -1;
+  case CMD_LIST_EVENTS:
+  case CMD_BARRIER:
+  case CMD_HELP:
+    return 1;
+  case CMD_EMPTY:
+  case CMD_INVALID:
+  case EOC:
+    return 0;
+  }
+  return 0;
+}
+
+/// Maps a file, decodes all its commands several times and prints the fastest run.
+/// @return 0 on success, 1 on failure.
+static int measure(const char *name, FILE *file, unsigned int repeat, struct Coords *coords) {
+  uint64_t best_index = UINT64_MAX, best_decode = UINT64_MAX;
+  size_t commands = 0, valid = 0, size = 0;
+
+  for (unsigned int r = 0; r < repeat; r++) {
+    struct JobsMap map;
+    uint64_t start = now_ns();
+    if (jobsmap_init(&map, fileno(file)) != 0) {
+      fprintf(stderr, "Failed to map the %s file\n", name);
+      return 1;
+    }
+    uint64_t indexed = now_ns();
+
+    const struct JobsDecoder *decoder = jobsbin_decoder(&map);
+    valid = 0;
+    for (size_t i = 0; i < map.num_lines; i++) {
+      struct Reader line;
+      jobsmap_line(&map, i, &line);
+      valid += (size_t)decode(decoder, &line, coords);
+    }
+    uint64_t decoded = now_ns();
+
+    if (indexed - start < best_index) {
+      best_index = indexed - start;
+    }
+    if (decoded - indexed < best_decode) {
+      best_decode = decoded - indexed;
+    }
+    commands = map.num_lines;
+    size = map.size;
+    jobsmap_destroy(&map);
+  }
+
+  printf("%-9s %8.1f %10zu %10zu %10.1f %10.1f %12.0f\n", name, (double)size / (1 << 20),
+         commands, valid, (double)best_index / 1e6, (double)best_decode / 1e6,
+         (double)commands / ((double)best_decode / 1e9));
+  return 0;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -s <MB>    size of the .jobs file (64)\n"
+          "  -r <runs>  runs of each format, the fastest is reported (3)\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  size_t size_mb = 64;
+  unsigned int repeat = 3;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:r:")) != -1) {
+    int fields = 0;
+    if (opt == 's') {
+      fields = sscanf(optarg, "%zu", &size_mb);
+    } else if (opt == 'r') {
+      fields = sscanf(optarg, "%u", &repeat);
+    }
+
+    if (fields != 1 || size_mb == 0 || repeat == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  FILE *text = tmpfile();
+  FILE *compiled = tmpfile();
+  if (text == NULL || compiled == NULL || generate(text, size_mb << 20) != 0 ||
+      jobsbin_compile(fileno(text), fileno(compiled)) != 0) {
+    fprintf(stderr, "Failed to write the .jobs files\n");
+    return 1;
+  }
+
+  printf("%-9s %8s %10s %10s %10s %10s %12s\n", "format", "MB", "commands", "valid",
+         "index ms", "decode ms", "commands/s");
+
+  struct Coords coords = {NULL, NULL, 0};
+  int failed = measure("text", text, repeat, &coords) != 0 ||
+               measure("compiled", compiled, repeat, &coords) != 0;
+
+  coords_destroy(&coords);
+  fclose(compiled);
+  fclose(text);
+  return failed;
+}
@@ -0,0 +1,285 @@
+/// Differential fuzz test of the RESERVE parser: parses mutated RESERVE lines
+/// and prints a hash of what was parsed, so that a build with RESERVE_FAST_SCAN
+/// and one without can be compared (see make check).
+/// @note Each input is parsed through a file, like the locked reader path, and
+/// line by line, like mapped files. Both must agree.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "reader.h"
+
+/// Parameters of an input.
+struct Fuzz {
+  unsigned int lines;    /// Number of lines.
+  unsigned int max_len;  /// Most coordinates of a RESERVE, before the mutations.
+  unsigned int mutate;   /// Percentage of mutated lines.
+  int dump;              /// 1 to print what was parsed instead of its hash.
+};
+
+static uint64_t rng_state;
+
+/// Gets the next number of the splitmix64 sequence.
+static uint64_t next_random(void) {
+  uint64_t z = (rng_state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+static unsigned int next_below(unsigned int n) {
+  return (unsigned int)(next_random() % n);
+}
+
+/// Gets a coordinate, sometimes 0 or too large for an unsigned int.
+static uint64_t next_coord(void) {
+  switch (next_below(8)) {
+  case 0:
+    return 0;
+  case 1:
+    return next_random() % ((uint64_t)1 << 33);
+  case 2:
+    return (uint64_t)4294967295u + next_below(2);
+  default:
+    return next_below(100);
+  }
+}
+
+/// Writes the input: RESERVE lines of which some have bytes replaced, dropped
+/// or inserted, including newlines that split them.
+/// @return The input, to be freed by the caller, NULL on failure.
+static char *generate(const struct Fuzz *fuzz, size_t *len) {
+  static const char alphabet[] = "0123456789(), ]x\n9[";
+
+  char *text = NULL;
+  FILE *file = open_memstream(&text, len);
+  if (file == NULL) {
+    return NULL;
+  }
+
+  char line[1 << 14];
+  for (unsigned int l = 0; l < fuzz->lines; l++) {
+    unsigned int num_coords = next_below(next_below(10) == 0 ? fuzz->max_len : 20) + 1;
+    size_t n = (size_t)snprintf(line, sizeof(line), "RESERVE %u [", next_below(51));
+    for (unsigned int c = 0; c < num_coords && n < sizeof(line) - 64; c++) {
+      n += (size_t)snprintf(line + n, sizeof(line) - n, "%s(%" PRIu64 ",%u)", c > 0 ? " " : "",
+                            next_coord(), next_below(10000));
+    }
+    line[n++] = ']';
+
+    if (next_below(100) < fuzz->mutate) {
+      for (unsigned int m = next_below(3) + 1; m > 0 && n > 0 && n < sizeof(line) - 1; m--) {
+        size_t at = next_below((unsigned int)n);
+        char ch = alphabet[next_below(sizeof(alphabet) - 1)];
+        unsigned int op = next_below(10);
+        if (op < 4) {
+          line[at] = ch;
+        } else if (op < 7) {
+          memmove(line + at, line + at + 1, n - at - 1);
+          n--;
+        } else {
+          memmove(line + at + 1, line + at, n - at);
+          line[at] = ch;
+          n++;
+        }
+      }
+    }
+    if (next_below(20) == 0 && n < sizeof(line) - 16) {
+      memcpy(line + n, " trailing", 9);
+      n += 9;
+    }
+
+    fwrite(line, 1, n, file);
+    if (l + 1 < fuzz->lines || next_below(2) == 0) {
+      fputc('\n', file);
+    }
+  }
+
+  if (fclose(file) != 0) {
+    free(text);
+    return NULL;
+  }
+  return text;
+}
+
+/// Parses the commands of a reader and records what was parsed.
+/// @param reader Reader to parse.
+/// @param coords Coordinates reused between commands.
+/// @param out Stream the parsed commands are written to.
+/// @param one_line 1 to stop after the first command.
+/// @return Number of RESERVE commands accepted.
+static size_t parse(struct Reader *reader, struct Coords *coords, FILE *out, int one_line) {
+  size_t accepted = 0;
+
+  while (1) {
+    enum Command command = get_next(reader);
+    if (command == EOC) {
+      break;
+    }
+
+    if (command == CMD_RESERVE) {
+      unsigned int event_id;
+      size_t num_coords = parse_reserve(reader, &event_id, coords);
+      if (num_coords == 0) {
+        fprintf(out, "RESERVE -\n");
+      } else {
+        accepted++;
+        fprintf(out, "RESERVE %u", event_id);
+        for (size_t i = 0; i < num_coords; i++) {
+          fprintf(out, " %u,%u", coords->xs[i], coords->ys[i]);
+        }
+        fputc('\n', out);
+      }
+    } else {
+      // Every other command is reported by its kind only.
+      if (command != CMD_INVALID && command != CMD_EMPTY) {
+        cleanup(reader);
+      }
+      fprintf(out, "%d\n", (int)command);
+    }
+
+    if (one_line) {
+      break;
+    }
+  }
+
+  return accepted;
+}
+
+/// Parses the input through a file, like a .jobs file that is not mapped.
+static int parse_file(char *text, size_t len, struct Coords *coords, FILE *out,
+                      size_t *accepted) {
+  FILE *file = tmpfile();
+  if (file == NULL || fwrite(text, 1, len, file) != len || fflush(file) != 0) {
+    fprintf(stderr, "Failed to write the input\n");
+    return 1;
+  }
+
+  struct Reader reader;
+  if (reader_init(&reader, fileno(file)) != 0) {
+    fclose(file);
+    return 1;
+  }
+
+  *accepted = parse(&reader, coords, out, 0);
+
+  reader_destroy(&reader);
+  fclose(file);
+  return 0;
+}
+
+/// Parses the input one line at a time, like a mapped .jobs file.
+static void parse_lines(char *text, size_t len, struct Coords *coords, FILE *out) {
+  size_t start = 0;
+  while (start < len) {
+    char *newline = memchr(text + start, '\n', len - start);
+    size_t stop = newline != NULL ? (size_t)(newline - text) + 1 : len;
+
+    struct Reader line;
+    reader_init_mem(&line, text + start, stop - start);
+    parse(&line, coords, out, 1);
+
+    start = stop;
+  }
+}
+
+/// Gets the FNV-1a hash of some bytes.
+static uint64_t hash(const char *bytes, size_t len) {
+  uint64_t h = 0xcbf29ce484222325;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (unsigned char)bytes[i]) * 0x100000001b3;
+  }
+  return h;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -x <seed>    random seed (1)\n"
+          "  -n <lines>   RESERVE lines (4000)\n"
+          "  -l <coords>  most coordinates of a long RESERVE (300)\n"
+          "  -m <pct>     percent of mutated lines (50)\n"
+          "  -d           print what was parsed instead of its hash\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  struct Fuzz fuzz = {4000, 300, 50, 0};
+  unsigned long long seed = 1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "x:n:l:m:d")) != -1) {
+    int fields = 1;
+    switch (opt) {
+    case 'x':
+      fields = sscanf(optarg, "%llu", &seed);
+      break;
+    case 'n':
+      fields = sscanf(optarg, "%u", &fuzz.lines);
+      break;
+    case 'l':
+      fields = sscanf(optarg, "%u", &fuzz.max_len);
+      break;
+    case 'm':
+      fields = sscanf(optarg, "%u", &fuzz.mutate);
+      break;
+    case 'd':
+      fuzz.dump = 1;
+      break;
+    default:
+      fields = 0;
+    }
+
+    if (fields != 1 || fuzz.max_len == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  rng_state = (uint64_t)seed;
+
+  size_t len;
+  char *text = generate(&fuzz, &len);
+  if (text == NULL) {
+    fprintf(stderr, "Failed to generate the input\n");
+    return 1;
+  }
+
+  char *by_file = NULL, *by_line = NULL;
+  size_t by_file_len, by_line_len, accepted = 0;
+  FILE *file_out = open_memstream(&by_file, &by_file_len);
+  FILE *line_out = open_memstream(&by_line, &by_line_len);
+  struct Coords coords = {NULL, NULL, 0};
+  if (file_out == NULL || line_out == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 1;
+  }
+
+  int failed = parse_file(text, len, &coords, file_out, &accepted);
+  parse_lines(text, len, &coords, line_out);
+  fclose(file_out);
+  fclose(line_out);
+
+  if (!failed && (by_file_len != by_line_len || memcmp(by_file, by_line, by_file_len) != 0)) {
+    fprintf(stderr, "seed %llu: the file and its lines were parsed differently\n", seed);
+    failed = 1;
+  }
+
+  if (fuzz.dump) {
+    fwrite(by_file, 1, by_file_len, stdout);
+  } else if (!failed) {
+    printf("seed %llu: %u lines, %zu bytes, %zu RESERVE accepted, parsed %016" PRIx64 "\n", seed,
+           fuzz.lines, len, accepted, hash(by_file, by_file_len));
+  }
+
+  coords_destroy(&coords);
+  free(by_file);
+  free(by_line);
+  free(text);
+
+  return failed;
+}
@@ -0,0 +1,230 @@
+/// Generator of synthetic .jobs files for the benchmarks (see run.sh).
+/// @note The output only depends on the options: the random numbers come from
+/// a fixed generator seeded with -x, not from the C library.
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_PATH 4096
+
+/// Parameters of a workload.
+struct Workload {
+  const char *dir;       /// Directory the .jobs files are written to.
+  unsigned int files;    /// Number of .jobs files.
+  unsigned int commands; /// Commands per file, not counting the CREATEs.
+  unsigned int events;   /// Events per file.
+  unsigned int rows;     /// Rows of every event.
+  unsigned int cols;     /// Columns of every event.
+  unsigned int size_min; /// Smallest RESERVE, in seats.
+  unsigned int size_max; /// Largest RESERVE, in seats.
+  double size_alpha;     /// Exponent of the RESERVE sizes, 0 for uniform sizes.
+  double event_alpha;    /// Exponent of the event ranks, 0 for no hot events.
+  unsigned int show_pct; /// Percentage of SHOW commands.
+  unsigned int list_pct; /// Percentage of LIST commands.
+  unsigned int best_pct; /// Percentage of RESERVE_BEST commands, the rest are RESERVE.
+  unsigned int barriers; /// BARRIERs per 1000 commands.
+};
+
+/// Power law over the integers from first to first + n - 1, where k is drawn
+/// with a weight of k^-alpha.
+struct PowerLaw {
+  double *cdf;
+  size_t n;
+  unsigned int first;
+};
+
+static uint64_t rng_state;
+
+/// Gets the next number of the splitmix64 sequence.
+static uint64_t next_random(void) {
+  uint64_t z = (rng_state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+/// Gets a uniform number in [0, 1).
+static double next_unit(void) {
+  return (double)(next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void powerlaw_init(struct PowerLaw *law, unsigned int first, unsigned int last,
+                          double alpha) {
+  law->first = first;
+  law->n = (size_t)(last - first) + 1;
+  law->cdf = (double *)malloc(law->n * sizeof(double));
+  if (law->cdf == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(1);
+  }
+
+  double sum = 0;
+  for (size_t i = 0; i < law->n; i++) {
+    sum += pow((double)(first + i), -alpha);
+    law->cdf[i] = sum;
+  }
+  for (size_t i = 0; i < law->n; i++) {
+    law->cdf[i] /= sum;
+  }
+}
+
+static unsigned int powerlaw_draw(const struct PowerLaw *law) {
+  double u = next_unit();
+  size_t lo = 0, hi = law->n - 1;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (law->cdf[mid] > u) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return law->first + (unsigned int)lo;
+}
+
+/// Writes one .jobs file of the workload.
+/// @return 0 if the file was written successfully, 1 otherwise.
+static int write_file(const struct Workload *w, unsigned int index, const struct PowerLaw *sizes,
+                      const struct PowerLaw *events) {
+  char path[MAX_PATH];
+  snprintf(path, sizeof(path), "%s/bench-%03u.jobs", w->dir, index);
+
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  for (unsigned int e = 1; e <= w->events; e++) {
+    fprintf(file, "CREATE %u %u %u\n", e, w->rows, w->cols);
+  }
+
+  uint64_t num_seats = (uint64_t)w->rows * w->cols;
+  for (unsigned int i = 0; i < w->commands; i++) {
+    if (w->barriers > 0 && next_random() % 1000 < w->barriers) {
+      fprintf(file, "BARRIER\n");
+    }
+
+    unsigned int event = powerlaw_draw(events);
+    unsigned int pick = (unsigned int)(next_random() % 100);
+
+    if (pick < w->show_pct) {
+      fprintf(file, "SHOW %u\n", event);
+    } else if (pick < w->show_pct + w->list_pct) {
+      fprintf(file, "LIST\n");
+    } else if (pick < w->show_pct + w->list_pct + w->best_pct) {
+      unsigned int size = powerlaw_draw(sizes);
+      fprintf(file, "RESERVE_BEST %u %u %u\n", event, size < w->cols ? size : w->cols,
+              (unsigned int)(next_random() % w->rows) + 1);
+    } else {
+      // The seats are consecutive from a random one, wrapping to the next row.
+      unsigned int size = powerlaw_draw(sizes);
+      uint64_t seat = next_random() % num_seats;
+      fprintf(file, "RESERVE %u [", event);
+      for (unsigned int k = 0; k < size; k++, seat = (seat + 1) % num_seats) {
+        fprintf(file, "%s(%u,%u)", k > 0 ? " " : "", (unsigned int)(seat / w->cols) + 1,
+                (unsigned int)(seat % w->cols) + 1);
+      }
+      fprintf(file, "]\n");
+    }
+  }
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Failed to close %s\n", path);
+    return 1;
+  }
+
+  return 0;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s -d <dir> [options]\n"
+          "  -f <files>              .jobs files (1)\n"
+          "  -n <commands>           commands per file, after the CREATEs (10000)\n"
+          "  -e <events>             events per file (16)\n"
+          "  -g <rows>x<cols>        size of every event (100x100)\n"
+          "  -s <min>:<max>[:<a>]    RESERVE sizes, weighted by size^-a (1:8:0)\n"
+          "  -z <a>                  hot events, event k weighted by k^-a (0)\n"
+          "  -m <show>:<list>:<best> percent of SHOW, LIST and RESERVE_BEST (5:1:0)\n"
+          "  -b <barriers>           BARRIERs per 1000 commands (0)\n"
+          "  -x <seed>               random seed (1)\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  struct Workload w = {NULL, 1, 10000, 16, 100, 100, 1, 8, 0, 0, 5, 1, 0, 0};
+  unsigned long long seed = 1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:f:n:e:g:s:z:m:b:x:")) != -1) {
+    int fields = 1;
+    switch (opt) {
+    case 'd':
+      w.dir = optarg;
+      break;
+    case 'f':
+      fields = sscanf(optarg, "%u", &w.files);
+      break;
+    case 'n':
+      fields = sscanf(optarg, "%u", &w.commands);
+      break;
+    case 'e':
+      fields = sscanf(optarg, "%u", &w.events);
+      break;
+    case 'g':
+      fields = sscanf(optarg, "%ux%u", &w.rows, &w.cols) == 2;
+      break;
+    case 's':
+      fields = sscanf(optarg, "%u:%u:%lf", &w.size_min, &w.size_max, &w.size_alpha) >= 2;
+      break;
+    case 'z':
+      fields = sscanf(optarg, "%lf", &w.event_alpha);
+      break;
+    case 'm':
+      fields = sscanf(optarg, "%u:%u:%u", &w.show_pct, &w.list_pct, &w.best_pct) == 3;
+      break;
+    case 'b':
+      fields = sscanf(optarg, "%u", &w.barriers);
+      break;
+    case 'x':
+      fields = sscanf(optarg, "%llu", &seed);
+      break;
+    default:
+      fields = 0;
+    }
+
+    if (fields != 1) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (w.dir == NULL || w.files == 0 || w.events == 0 || w.rows == 0 || w.cols == 0 ||
+      w.size_min == 0 || w.size_min > w.size_max ||
+      w.show_pct + w.list_pct + w.best_pct > 100 || w.barriers > 1000) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  rng_state = (uint64_t)seed;
+
+  struct PowerLaw sizes, events;
+  powerlaw_init(&sizes, w.size_min, w.size_max, w.size_alpha);
+  powerlaw_init(&events, 1, w.events, w.event_alpha);
+
+  int failed = 0;
+  for (unsigned int i = 0; i < w.files && !failed; i++) {
+    failed = write_file(&w, i, &sizes, &events);
+  }
+
+  free(sizes.cdf);
+  free(events.cdf);
+
+  return failed;
+}
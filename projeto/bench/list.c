@@ -0,0 +1,195 @@
+/// Cost of LIST with 10k and 100k events: the latency of one ems_list_events
+/// to /dev/null, then the LISTs per second of 1 to 8 threads listing at once.
+/// @note The events are created by many threads at once, as ems_create sleeps
+/// for the state access delay, which is set to 0 but still costs a nanosleep.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "operations.h"
+
+/// Threads that create the events.
+#define CREATE_THREADS 32
+
+/// Most threads listing at once.
+#define MAX_LISTERS 8
+
+/// Events created by a thread.
+struct Creator {
+  unsigned int first; /// Id of the first event.
+  unsigned int last;  /// Id of the last event.
+  int failed;
+};
+
+/// Thread listing the events.
+struct Lister {
+  int out_fd;
+  pthread_mutex_t *mutex;
+  unsigned int lists; /// LISTs to run.
+  pthread_barrier_t *start;
+};
+
+/// Gets the current time.
+/// @return Nanoseconds of the monotonic clock.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void *create_events(void *arg) {
+  struct Creator *creator = (struct Creator *)arg;
+  for (unsigned int id = creator->first; id <= creator->last && !creator->failed; id++) {
+    creator->failed = ems_create(id, 1, 1) != 0;
+  }
+  return NULL;
+}
+
+/// Creates the events with ids from first to last.
+/// @return 0 on success, 1 on failure.
+static int create(unsigned int first, unsigned int last) {
+  pthread_t threads[CREATE_THREADS];
+  struct Creator creators[CREATE_THREADS];
+  unsigned int per_thread = (last - first + CREATE_THREADS) / CREATE_THREADS;
+
+  for (unsigned int i = 0; i < CREATE_THREADS; i++) {
+    unsigned int start = first + i * per_thread;
+    unsigned int stop = start + per_thread - 1 < last ? start + per_thread - 1 : last;
+    creators[i] = (struct Creator){start, stop, 0};
+    if (pthread_create(&threads[i], NULL, create_events, &creators[i]) != 0) {
+      fprintf(stderr, "Failed to create thread\n");
+      return 1;
+    }
+  }
+
+  int failed = 0;
+  for (unsigned int i = 0; i < CREATE_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    failed |= creators[i].failed;
+  }
+  return failed;
+}
+
+static void *list_events(void *arg) {
+  struct Lister *lister = (struct Lister *)arg;
+  safe_barrier_wait(lister->start);
+  for (unsigned int l = 0; l < lister->lists; l++) {
+    ems_list_events(lister->out_fd, lister->mutex);
+  }
+  return NULL;
+}
+
+/// Runs LISTs from several threads at once.
+/// @return LISTs per second.
+static double measure_threads(unsigned int num_threads, unsigned int lists, int out_fd,
+                              pthread_mutex_t *mutex) {
+  pthread_t threads[MAX_LISTERS];
+  struct Lister listers[MAX_LISTERS];
+  pthread_barrier_t start;
+  safe_barrier_init(&start, num_threads + 1);
+
+  for (unsigned int i = 0; i < num_threads; i++) {
+    listers[i] = (struct Lister){out_fd, mutex, lists, &start};
+    if (pthread_create(&threads[i], NULL, list_events, &listers[i]) != 0) {
+      fprintf(stderr, "Failed to create thread\n");
+      exit(1);
+    }
+  }
+
+  safe_barrier_wait(&start);
+  uint64_t begin = now_ns();
+  for (unsigned int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  uint64_t elapsed = now_ns() - begin;
+
+  safe_barrier_destroy(&start);
+  return (double)lists * num_threads / ((double)elapsed / 1e9);
+}
+
+/// Measures LIST with the events created so far.
+static void measure(unsigned int num_events, unsigned int lists, int out_fd,
+                    pthread_mutex_t *mutex) {
+  uint64_t best_ns = UINT64_MAX, total_ns = 0;
+  for (unsigned int l = 0; l < lists; l++) {
+    uint64_t start = now_ns();
+    ems_list_events(out_fd, mutex);
+    uint64_t elapsed = now_ns() - start;
+    total_ns += elapsed;
+    if (elapsed < best_ns) {
+      best_ns = elapsed;
+    }
+  }
+
+  printf("%8u %10.3f %10.3f", num_events, (double)best_ns / 1e6,
+         (double)total_ns / lists / 1e6);
+  for (unsigned int t = 1; t <= MAX_LISTERS; t *= 2) {
+    printf(" %9.0f", measure_threads(t, lists, out_fd, mutex));
+  }
+  printf("\n");
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -m <events>  largest number of events, from 10000 by tenfold (100000)\n"
+          "  -r <runs>    LISTs of each thread and for the latency (200)\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int max_events = 100000, lists = 200;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:r:")) != -1) {
+    int fields = 0;
+    if (opt == 'm') {
+      fields = sscanf(optarg, "%u", &max_events);
+    } else if (opt == 'r') {
+      fields = sscanf(optarg, "%u", &lists);
+    }
+
+    if (fields != 1 || lists == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (null_fd < 0 || ems_init(0, LOCK_STRIPED, 0) != 0) {
+    fprintf(stderr, "Failed to initialize\n");
+    return 1;
+  }
+
+  pthread_mutex_t mutex;
+  safe_mutex_init(&mutex);
+
+  printf("%8s %10s %10s", "events", "best ms", "mean ms");
+  for (unsigned int t = 1; t <= MAX_LISTERS; t *= 2) {
+    printf(" %7u thr", t);
+  }
+  printf("   (LISTs/s)\n");
+
+  // The EMS state is initialized once per process, so the larger stores are
+  // grown from the smaller ones.
+  int failed = 0;
+  unsigned int num_events = 0;
+  for (unsigned int target = 10000; target <= max_events; target *= 10) {
+    failed = create(num_events + 1, target) != 0;
+    if (failed) {
+      fprintf(stderr, "Failed to create the events\n");
+      break;
+    }
+    num_events = target;
+    measure(num_events, lists, null_fd, &mutex);
+  }
+
+  safe_mutex_destroy(&mutex);
+  ems_terminate();
+  close(null_fd);
+  return failed;
+}
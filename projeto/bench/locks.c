@@ -0,0 +1,247 @@
+/// Memory and throughput of the seat locks of one event, for LOCK_ROW,
+/// LOCK_STRIPED and LOCK_ATOMIC, against one rwlock per seat like the former
+/// seat locks. Threads lock the seats of random reservations with
+/// seatlock_wrlock_all, count them as taken and unlock them.
+/// @note The event is built here rather than with ems_create, so that the state
+/// access delay of the server is not measured.
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eventlist.h"
+#include "operations.h"
+#include "seatlock.h"
+
+/// Most seats of a reservation.
+#define MAX_SEATS 64
+
+/// Lock layout being measured.
+struct Layout {
+  const char *name;
+  enum LockMode mode;
+  int per_seat; /// 1 for one rwlock per seat, mode is then unused.
+};
+
+/// State shared by the threads of a measurement.
+struct Bench {
+  struct Event event;
+  pthread_rwlock_t *locks; /// Locks of the event, or of each seat.
+  int per_seat;
+  atomic_uint *seats;      /// Times each seat was taken.
+  size_t num_seats;        /// Seats of the event.
+  size_t seats_per_op;     /// Seats of each reservation.
+  size_t ops;              /// Reservations of each thread.
+  pthread_barrier_t start;
+};
+
+struct Worker {
+  struct Bench *bench;
+  unsigned int id;
+};
+
+/// Gets the current time.
+/// @return Nanoseconds of the monotonic clock.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/// Takes the seats of a reservation with the locks of the event.
+static void take_event(struct Bench *bench, const size_t *seats, size_t num_seats) {
+  size_t held[MAX_SEATS];
+  size_t num_held = seatlock_wrlock_all(&bench->event, seats, num_seats, held);
+  for (size_t i = 0; i < num_seats; i++) {
+    atomic_fetch_add_explicit(&bench->seats[seats[i]], 1, memory_order_relaxed);
+  }
+  seatlock_unlock_all(&bench->event, held, num_held);
+}
+
+/// Takes the seats of a reservation with a lock of each seat, in increasing order.
+static void take_per_seat(struct Bench *bench, const size_t *seats, size_t num_seats) {
+  for (size_t i = 0; i < num_seats; i++) {
+    safe_rwlock_wrlock(&bench->locks[seats[i]]);
+  }
+  for (size_t i = 0; i < num_seats; i++) {
+    atomic_fetch_add_explicit(&bench->seats[seats[i]], 1, memory_order_relaxed);
+  }
+  for (size_t i = num_seats; i > 0; i--) {
+    safe_rwlock_unlock(&bench->locks[seats[i - 1]]);
+  }
+}
+
+static void *reserve_seats(void *arg) {
+  struct Worker *worker = (struct Worker *)arg;
+  struct Bench *bench = worker->bench;
+  uint64_t state = worker->id + 1;
+  size_t seats[2 * MAX_SEATS];
+
+  safe_barrier_wait(&bench->start);
+
+  for (size_t op = 0; op < bench->ops; op++) {
+    for (size_t i = 0; i < bench->seats_per_op; i++) {
+      state = state * 6364136223846793005 + 1442695040888963407;
+      seats[i] = (size_t)(state >> 24) % bench->num_seats;
+    }
+    size_t num_seats =
+        sort_seats(seats, seats + MAX_SEATS, bench->seats_per_op, bench->num_seats);
+
+    if (bench->per_seat) {
+      take_per_seat(bench, seats, num_seats);
+    } else {
+      take_event(bench, seats, num_seats);
+    }
+  }
+
+  return NULL;
+}
+
+/// Runs the reservations of some threads on a layout.
+/// @return Reservations per second.
+static double measure(struct Bench *bench, unsigned int num_threads) {
+  pthread_t *threads = (pthread_t *)safe_malloc(num_threads * sizeof(pthread_t));
+  struct Worker *workers = (struct Worker *)safe_malloc(num_threads * sizeof(struct Worker));
+  safe_barrier_init(&bench->start, num_threads + 1);
+
+  for (unsigned int i = 0; i < num_threads; i++) {
+    workers[i] = (struct Worker){bench, i};
+    if (pthread_create(&threads[i], NULL, reserve_seats, &workers[i]) != 0) {
+      fprintf(stderr, "Failed to create thread\n");
+      exit(1);
+    }
+  }
+
+  safe_barrier_wait(&bench->start);
+  uint64_t start = now_ns();
+  for (unsigned int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  safe_barrier_destroy(&bench->start);
+  free(workers);
+  free(threads);
+  return (double)(bench->ops * num_threads) / ((double)elapsed / 1e9);
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -g <rows>x<cols>  size of the event (1000x1000)\n"
+          "  -k <seats>        seats of each reservation, at most %d (4)\n"
+          "  -t <threads>      most threads, from 1 by doubling (16)\n"
+          "  -n <ops>          reservations of each thread (200000)\n",
+          name, MAX_SEATS);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int rows = 1000, cols = 1000, max_threads = 16;
+  size_t seats_per_op = 4, ops = 200000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "g:k:t:n:")) != -1) {
+    int fields = 0;
+    switch (opt) {
+    case 'g':
+      fields = sscanf(optarg, "%ux%u", &rows, &cols) == 2;
+      break;
+    case 'k':
+      fields = sscanf(optarg, "%zu", &seats_per_op);
+      break;
+    case 't':
+      fields = sscanf(optarg, "%u", &max_threads);
+      break;
+    case 'n':
+      fields = sscanf(optarg, "%zu", &ops);
+      break;
+    default:
+      fields = 0;
+    }
+
+    if (fields != 1 || rows == 0 || cols == 0 || seats_per_op == 0 ||
+        seats_per_op > MAX_SEATS || max_threads == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  const struct Layout layouts[] = {
+      {"seat", LOCK_ROW, 1},
+      {"row", LOCK_ROW, 0},
+      {"striped", LOCK_STRIPED, 0},
+      {"atomic", LOCK_ATOMIC, 0},
+  };
+  size_t num_layouts = sizeof(layouts) / sizeof(layouts[0]);
+  size_t num_seats = (size_t)rows * cols;
+
+  struct Bench bench;
+  bench.num_seats = num_seats;
+  bench.seats_per_op = seats_per_op;
+  bench.ops = ops;
+  bench.seats = (atomic_uint *)calloc(num_seats, sizeof(atomic_uint));
+  if (bench.seats == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 1;
+  }
+
+  printf("%ux%u event, %zu seats per reservation, %zu reservations per thread\n", rows, cols,
+         seats_per_op, ops);
+  printf("%-8s %8s %12s %9s", "locks", "count", "lock bytes", "B/seat");
+  for (unsigned int t = 1; t <= max_threads; t *= 2) {
+    printf(" %7u thr", t);
+  }
+  printf("   (reservations/s)\n");
+
+  for (size_t l = 0; l < num_layouts; l++) {
+    const struct Layout *layout = &layouts[l];
+    size_t num_locks =
+        layout->per_seat ? num_seats : seatlock_count(layout->mode, rows, cols);
+
+    bench.per_seat = layout->per_seat;
+    bench.locks = (pthread_rwlock_t *)malloc((num_locks > 0 ? num_locks : 1) *
+                                             sizeof(pthread_rwlock_t));
+    if (bench.locks == NULL) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      return 1;
+    }
+
+    memset(&bench.event, 0, sizeof(bench.event));
+    bench.event.rows = rows;
+    bench.event.cols = cols;
+    if (layout->per_seat) {
+      for (size_t i = 0; i < num_locks; i++) {
+        safe_rwlock_init(&bench.locks[i]);
+      }
+    } else {
+      seatlock_init(&bench.event, layout->mode, bench.locks, 0);
+    }
+
+    size_t lock_bytes = num_locks * sizeof(pthread_rwlock_t);
+    printf("%-8s %8zu %12zu %9.3f", layout->name, num_locks, lock_bytes,
+           (double)lock_bytes / (double)num_seats);
+    fflush(stdout);
+
+    for (unsigned int t = 1; t <= max_threads; t *= 2) {
+      printf(" %11.0f", measure(&bench, t));
+      fflush(stdout);
+    }
+    printf("\n");
+
+    if (layout->per_seat) {
+      for (size_t i = 0; i < num_locks; i++) {
+        safe_rwlock_destroy(&bench.locks[i]);
+      }
+    } else {
+      seatlock_destroy(&bench.event);
+    }
+    free(bench.locks);
+  }
+
+  free(bench.seats);
+  return 0;
+}
@@ -0,0 +1,130 @@
+/// Latency of get_event in event stores of 1k, 10k, 100k and 1M events, for
+/// ids that are found and ids that are not, against a walk of a linked list of
+/// the same events like the former event list.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "constants.h"
+#include "eventlist.h"
+
+/// Nodes visited by the list walks of each store size, at most.
+#define LIST_VISITS ((size_t)1 << 27)
+
+/// Lookups of each kind in the event store.
+#define LOOKUPS ((size_t)1 << 22)
+
+/// Node of the former linked event list.
+struct ListNode {
+  struct Event *event;
+  struct ListNode *next;
+};
+
+/// Gets the current time.
+/// @return Nanoseconds of the monotonic clock.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/// Gets the id of the i-th event: distinct, but not consecutive.
+static unsigned int event_id(size_t i) {
+  return (unsigned int)((i + 1) * 2654435761u);
+}
+
+static struct Event *walk_list(struct ListNode *head, unsigned int id) {
+  for (struct ListNode *node = head; node != NULL; node = node->next) {
+    if (node->event->id == id) {
+      return node->event;
+    }
+  }
+  return NULL;
+}
+
+/// Measures the lookups in a store of num_events events.
+/// @return 0 on success, 1 on failure.
+static int measure(size_t num_events) {
+  struct Arena *arena = arena_create(EMS_ARENA_SIZE, 0);
+  struct EventList *list = arena != NULL ? create_list(arena) : NULL;
+  struct ListNode *nodes = (struct ListNode *)malloc(num_events * sizeof(struct ListNode));
+  if (list == NULL || nodes == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < num_events; i++) {
+    struct Event *event = (struct Event *)arena_alloc(arena, sizeof(struct Event));
+    if (event == NULL) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      return 1;
+    }
+    memset(event, 0, sizeof(struct Event));
+    event->id = event_id(i);
+    if (append_to_list(list, event) != 0) {
+      fprintf(stderr, "Failed to append event\n");
+      return 1;
+    }
+    nodes[i] = (struct ListNode){event, i + 1 < num_events ? &nodes[i + 1] : NULL};
+  }
+
+  uint64_t state = num_events;
+  size_t found = 0;
+
+  uint64_t start = now_ns();
+  for (size_t l = 0; l < LOOKUPS; l++) {
+    state = state * 6364136223846793005 + 1442695040888963407;
+    found += get_event(list, event_id((size_t)(state >> 33) % num_events)) != NULL;
+  }
+  double hit_ns = (double)(now_ns() - start) / (double)LOOKUPS;
+
+  // Ids of the form (i + 1) * 2654435761 for i past the last event are never stored.
+  start = now_ns();
+  for (size_t l = 0; l < LOOKUPS; l++) {
+    state = state * 6364136223846793005 + 1442695040888963407;
+    found += get_event(list, event_id(num_events + (size_t)(state >> 33) % num_events)) != NULL;
+  }
+  double miss_ns = (double)(now_ns() - start) / (double)LOOKUPS;
+
+  size_t walks = LIST_VISITS / num_events > 0 ? LIST_VISITS / num_events : 1;
+  start = now_ns();
+  for (size_t l = 0; l < walks; l++) {
+    state = state * 6364136223846793005 + 1442695040888963407;
+    found += walk_list(nodes, event_id((size_t)(state >> 33) % num_events)) != NULL;
+  }
+  double walk_ns = (double)(now_ns() - start) / (double)walks;
+
+  printf("%9zu %11.1f %12.1f %13.1f %10.0fx  (%zu found)\n", num_events, hit_ns, miss_ns, walk_ns,
+         walk_ns / hit_ns, found);
+
+  free(nodes);
+  free_list(list);
+  arena_destroy(arena);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_events = 1000000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:")) != -1) {
+    if (opt != 'm' || sscanf(optarg, "%zu", &max_events) != 1) {
+      fprintf(stderr, "Usage: %s [-m <largest store, in events (1000000)>]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  printf("%9s %11s %12s %13s %11s\n", "events", "hit ns", "miss ns", "list walk ns", "speedup");
+  for (size_t num_events = 1000; num_events <= max_events; num_events *= 10) {
+    if (measure(num_events) != 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
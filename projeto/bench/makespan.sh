@@ -0,0 +1,82 @@
+#!/bin/sh
+# Measures the makespan of a directory of .jobs files of mixed sizes: one large
+# file and several small ones, run with bench/ems-bench, which starts the files
+# by decreasing size (JOBS_LARGEST_FIRST), and with bench/ems-bench-fifo, which
+# starts them in directory order.
+#
+# Usage: bench/makespan.sh
+#
+# Environment:
+#   MAKESPAN_PROCS   MAX_PROC values of the sweep ("2 4")
+#   MAKESPAN_SMALL   small files (7)
+#   MAKESPAN_SIZES   commands of each small file and of the large file ("1000 8000")
+#   BENCH_REPEAT     runs of each point, the fastest is reported (3)
+#   BENCH_DIR        scratch directory (bench/work)
+#
+# The large file is placed last in directory order, the worst case for
+# ems-bench-fifo. Every file runs with one thread, so a file takes the time of
+# its commands and the makespan only depends on the order the files start in.
+
+set -e
+
+cd "$(dirname "$0")"
+
+PROCS=${MAKESPAN_PROCS:-"2 4"}
+SMALL=${MAKESPAN_SMALL:-7}
+SIZES=${MAKESPAN_SIZES:-"1000 8000"}
+REPEAT=${BENCH_REPEAT:-3}
+DIR=${BENCH_DIR:-work}/makespan
+
+small_commands=${SIZES% *}
+large_commands=${SIZES#* }
+
+rm -rf "$DIR"
+mkdir -p "$DIR/small" "$DIR/large"
+
+./gen -d "$DIR/small" -f "$SMALL" -n "$small_commands" -x 1
+./gen -d "$DIR/large" -f 1 -n "$large_commands" -x 2
+
+# The order of a directory is up to the file system, which may hash the names:
+# the large file is renamed until it is listed last.
+mkdir "$DIR/run"
+cp "$DIR"/small/*.jobs "$DIR/run/"
+large=large-0.jobs
+cp "$DIR/large/bench-000.jobs" "$DIR/run/$large"
+n=1
+while [ "$(ls -U "$DIR/run" | tail -n 1)" != "$large" ] && [ "$n" -lt 256 ]; do
+  mv "$DIR/run/$large" "$DIR/run/large-$n.jobs"
+  large=large-$n.jobs
+  n=$((n + 1))
+done
+
+order=$(ls -U "$DIR/run" | tr '\n' ' ')
+echo "workload: $SMALL files of $small_commands commands, 1 of $large_commands"
+echo "directory order: $order"
+printf '%5s %11s %11s %9s\n' procs largest_s directory_s speedup
+
+now_ns() {
+  date +%s%N
+}
+
+# Prints the wall time of the fastest run of a binary, in nanoseconds.
+fastest() {
+  best=
+  i=0
+  while [ "$i" -lt "$REPEAT" ]; do
+    start=$(now_ns)
+    "./$1" "$DIR/run" "$2" 1 0 >/dev/null 2>&1
+    elapsed=$(( $(now_ns) - start ))
+    if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+      best=$elapsed
+    fi
+    i=$((i + 1))
+  done
+  echo "$best"
+}
+
+for procs in $PROCS; do
+  largest=$(fastest ems-bench "$procs")
+  directory=$(fastest ems-bench-fifo "$procs")
+  awk -v p="$procs" -v l="$largest" -v d="$directory" \
+    'BEGIN { printf "%5d %11.3f %11.3f %8.2fx\n", p, l / 1e9, d / 1e9, d / l }'
+done
@@ -0,0 +1,205 @@
+/// Cost of reading a .jobs file: a generated file of mixed commands is parsed
+/// through the buffered reader, then a prefix of it through a reader that
+/// refills one byte at a time, like the former read(fd, &c, 1) parser. Reports
+/// the commands parsed per second and the pread calls per megabyte.
+/// @note Built with -Wl,--wrap=pread, so that every pread is counted. The
+/// commands are parsed but not run. The file is in the page cache, so the time
+/// is that of the parser and of the system calls, not of the disk.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "parser.h"
+#include "reader.h"
+
+/// Events created at the top of the file and used by its commands.
+#define NUM_EVENTS 1000
+
+static size_t num_preads;
+
+ssize_t __real_pread(int fd, void *buf, size_t count, off_t offset);
+
+/// Counts the calls of the reader to pread, linked in its place.
+ssize_t __wrap_pread(int fd, void *buf, size_t count, off_t offset) {
+  num_preads++;
+  return __real_pread(fd, buf, count, offset);
+}
+
+/// Gets the current time.
+/// @return Nanoseconds of the monotonic clock.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/// Writes at least the given number of bytes of commands, always the same ones:
+/// RESERVEs of 1 to 8 seats, then SHOW, RESERVE_BEST, LIST, WAIT and BARRIER.
+/// @return 0 on success, 1 on failure.
+static int generate(FILE *file, size_t bytes) {
+  char line[256];
+  size_t written = 0;
+
+  for (unsigned int e = 1; e <= NUM_EVENTS; e++) {
+    written += (size_t)fprintf(file, "CREATE %u 100 100\n", e);
+  }
+
+  uint64_t state = 1;
+  while (written < bytes) {
+    state = state * 6364136223846793005 + 1442695040888963407;
+    unsigned int kind = (unsigned int)(state >> 33) % 100;
+    unsigned int event = (unsigned int)(state >> 17) % NUM_EVENTS + 1;
+    int n;
+
+    if (kind < 60) {
+      unsigned int num_seats = (unsigned int)(state >> 45) % 8 + 1;
+      n = snprintf(line, sizeof(line), "RESERVE %u [", event);
+      for (unsigned int s = 0; s < num_seats; s++) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        n += snprintf(line + n, sizeof(line) - (size_t)n, "%s(%u,%u)", s > 0 ? " " : "",
+                      (unsigned int)(state >> 33) % 100 + 1, (unsigned int)(state >> 17) % 100 + 1);
+      }
+      n += snprintf(line + n, sizeof(line) - (size_t)n, "]\n");
+    } else if (kind < 75) {
+      n = snprintf(line, sizeof(line), "SHOW %u\n", event);
+    } else if (kind < 85) {
+      n = snprintf(line, sizeof(line), "RESERVE_BEST %u %u %u\n", event, kind % 8 + 1,
+                   (unsigned int)(state >> 45) % 100);
+    } else if (kind < 90) {
+      n = snprintf(line, sizeof(line), "LIST\n");
+    } else if (kind < 97) {
+      n = snprintf(line, sizeof(line), "WAIT %u\n", kind % 10);
+    } else {
+      n = snprintf(line, sizeof(line), "BARRIER\n");
+    }
+
+    written += fwrite(line, 1, (size_t)n, file);
+  }
+
+  return fflush(file) != 0 || ferror(file);
+}
+
+/// Parses every command of a reader, like the threads that run a .jobs file.
+/// @return Number of commands parsed.
+static size_t parse_all(struct Reader *reader, struct Coords *coords) {
+  unsigned int event_id, delay, thread_id;
+  size_t rows, cols, num_seats, row_hint;
+  size_t commands = 0;
+
+  while (1) {
+    switch (get_next(reader)) {
+    case CMD_CREATE:
+      parse_create(reader, &event_id, &rows, &cols);
+      break;
+    case CMD_RESERVE:
+      parse_reserve(reader, &event_id, coords);
+      break;
+    case CMD_RESERVE_BEST:
+      parse_reserve_best(reader, &event_id, &num_seats, &row_hint);
+      break;
+    case CMD_SHOW:
+      parse_show(reader, &event_id);
+      break;
+    case CMD_STATS:
+      parse_stats(reader, &event_id);
+      break;
+    case CMD_WAIT:
+      parse_wait(reader, &delay, &thread_id);
+      break;
+    case CMD_BARRIER:
+      // The BARRIER is given back for the other threads, which pass_barrier skips.
+      cleanup(reader);
+      break;
+    case CMD_LIST_EVENTS:
+    case CMD_HELP:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+      break;
+    case EOC:
+      return commands;
+    }
+    commands++;
+  }
+}
+
+/// Parses a file and prints the commands per second and the preads per megabyte.
+/// @param name Name of the reader.
+/// @param file File to parse.
+/// @param refill Bytes read by each refill, the whole buffer if 0.
+/// @return 0 on success, 1 on failure.
+static int measure(const char *name, FILE *file, size_t refill, struct Coords *coords) {
+  struct Reader reader;
+  if (reader_init(&reader, fileno(file)) != 0) {
+    return 1;
+  }
+  // A refill keeps READER_UNREAD_MAX bytes, so a smaller buffer reads less.
+  if (refill > 0) {
+    reader.size = READER_UNREAD_MAX + refill;
+  }
+
+  num_preads = 0;
+  uint64_t start = now_ns();
+  size_t commands = parse_all(&reader, coords);
+  double seconds = (double)(now_ns() - start) / 1e9;
+  double mb = (double)reader.offset / (1 << 20);
+
+  printf("%-12s %8.0f %10zu %12.0f %9.1f %14zu %12.1f\n", name, mb, commands,
+         (double)commands / seconds, mb / seconds, num_preads, (double)num_preads / mb);
+
+  reader_destroy(&reader);
+  return 0;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -s <MB>  size of the file parsed by the buffered reader (256)\n"
+          "  -b <MB>  size of the prefix parsed one byte at a time (16)\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  size_t size_mb = 256, byte_mb = 16;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:b:")) != -1) {
+    int fields = 0;
+    if (opt == 's') {
+      fields = sscanf(optarg, "%zu", &size_mb);
+    } else if (opt == 'b') {
+      fields = sscanf(optarg, "%zu", &byte_mb);
+    }
+
+    if (fields != 1 || size_mb == 0 || byte_mb == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // The prefix is a file of its own, generated from the same sequence.
+  FILE *file = tmpfile();
+  FILE *prefix = tmpfile();
+  if (file == NULL || prefix == NULL || generate(file, size_mb << 20) != 0 ||
+      generate(prefix, byte_mb << 20) != 0) {
+    fprintf(stderr, "Failed to write the .jobs file\n");
+    return 1;
+  }
+
+  printf("READER_BUFFER_SIZE=%d, %zu events\n", READER_BUFFER_SIZE, (size_t)NUM_EVENTS);
+  printf("%-12s %8s %10s %12s %9s %14s %12s\n", "reader", "MB", "commands", "commands/s", "MB/s",
+         "preads", "preads/MB");
+
+  struct Coords coords = {NULL, NULL, 0};
+  int failed = measure("buffered", prefix, 0, &coords) != 0 ||
+               measure("byte", prefix, 1, &coords) != 0 ||
+               measure("buffered", file, 0, &coords) != 0;
+
+  coords_destroy(&coords);
+  fclose(prefix);
+  fclose(file);
+  return failed;
+}
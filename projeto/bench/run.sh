@@ -0,0 +1,89 @@
+#!/bin/sh
+# Runs the benchmark suite: generates a workload with bench/gen, then runs it
+# with bench/ems-bench for every MAX_PROC and MAX_THREADS of the sweep.
+#
+# Usage: bench/run.sh [gen options]
+#   The options are passed to bench/gen (see bench/gen -h), -d excepted.
+#
+# Environment:
+#   BENCH_PROCS     MAX_PROC values of the sweep ("1 2 4")
+#   BENCH_THREADS   MAX_THREADS values of the sweep ("1 2 4 8")
+#   BENCH_REPEAT    runs of each point, the fastest is reported (3)
+#   BENCH_DELAY     state access delay in ms (0)
+#   BENCH_COMPILED  1 to run the workload compiled to .jobsb (0)
+#   BENCH_DIR       scratch directory (bench/work)
+#
+# For each point it prints the wall time of the fastest run, the commands run
+# per second and, for each command type, the p50 and p99 latency in
+# microseconds, merged from the .stats histograms of every file.
+
+set -e
+
+cd "$(dirname "$0")"
+
+PROCS=${BENCH_PROCS:-"1 2 4"}
+THREADS=${BENCH_THREADS:-"1 2 4 8"}
+REPEAT=${BENCH_REPEAT:-3}
+DELAY=${BENCH_DELAY:-0}
+COMPILED=${BENCH_COMPILED:-0}
+DIR=${BENCH_DIR:-work}
+
+rm -rf "$DIR"
+mkdir -p "$DIR/src" "$DIR/run"
+
+./gen -d "$DIR/src" "$@"
+commands=$(cat "$DIR"/src/*.jobs | grep -c .)
+
+for jobs in "$DIR"/src/*.jobs; do
+  if [ "$COMPILED" = 1 ]; then
+    ./ems-bench compile "$jobs" "$DIR/run/$(basename "$jobs" .jobs).jobsb"
+  else
+    cp "$jobs" "$DIR/run/"
+  fi
+done
+
+echo "workload: $* ($commands commands, compiled=$COMPILED, delay=${DELAY}ms)"
+printf '%5s %7s %9s %11s  %s\n' procs threads wall_s cmds/s "p50/p99 us per command"
+
+now_ns() {
+  date +%s%N
+}
+
+for procs in $PROCS; do
+  for threads in $THREADS; do
+    best=
+    i=0
+    while [ "$i" -lt "$REPEAT" ]; do
+      start=$(now_ns)
+      ./ems-bench "$DIR/run" "$procs" "$threads" "$DELAY" >/dev/null 2>&1
+      elapsed=$(( $(now_ns) - start ))
+      if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+        best=$elapsed
+        cat "$DIR"/run/*.stats >"$DIR/best.stats"
+      fi
+      i=$((i + 1))
+    done
+
+    # Merges the buckets of every file, then walks them in increasing order.
+    latencies=$(awk '$1 == "bucket" { print $2, $3, $4 }' "$DIR/best.stats" | sort -k1,1 -k2,2n |
+      awk '
+        { count[$1] += $3; n[$1]++; value[$1, n[$1]] = $2; hits[$1, n[$1]] = $3 }
+        END {
+          split("create reserve reserve_best show list stats wait", order, " ")
+          for (o = 1; o <= 7; o++) {
+            t = order[o]
+            if (!(t in count)) continue
+            p50 = ""; p99 = ""; seen = 0
+            for (i = 1; i <= n[t]; i++) {
+              seen += hits[t, i]
+              if (p50 == "" && seen >= count[t] * 0.50) p50 = value[t, i]
+              if (p99 == "" && seen >= count[t] * 0.99) p99 = value[t, i]
+            }
+            printf "%s %.1f/%.1f  ", t, p50 / 1000, p99 / 1000
+          }
+        }')
+
+    awk -v p="$procs" -v t="$threads" -v ns="$best" -v c="$commands" -v l="$latencies" \
+      'BEGIN { printf "%5d %7d %9.3f %11.0f  %s\n", p, t, ns / 1e9, c / (ns / 1e9), l }'
+  done
+done
@@ -0,0 +1,167 @@
+/// Throughput of the RESERVE tokenizer, in bytes per second and cycles per
+/// byte, for coordinate lists of several lengths: scan_coords alone, then whole
+/// RESERVE commands through parse_reserve.
+/// @note bench/scan-scalar is the same driver built without RESERVE_FAST_SCAN,
+/// so its parse_reserve column is the byte by byte parser.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "constants.h"
+#include "parser.h"
+#include "reader.h"
+#include "scan.h"
+
+/// Bytes of RESERVE commands generated for each list length.
+#define INPUT_BYTES ((size_t)16 << 20)
+
+/// RESERVE commands of one list length.
+struct Input {
+  char *text;
+  size_t len;
+  size_t *lists;     /// Offset of the byte after the '[' of each command.
+  size_t num_lines;
+  size_t list_bytes; /// Bytes of the coordinate lists, '[' excluded and ']' included.
+};
+
+/// Gets the current time.
+/// @return Nanoseconds of the monotonic clock.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/// Gets the time stamp counter, 0 where there is none.
+static uint64_t now_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/// Writes RESERVE commands of num_coords seats each, of up to four digits.
+/// @return 0 on success, 1 on failure.
+static int generate(struct Input *input, unsigned int num_coords) {
+  size_t capacity = INPUT_BYTES + 64 * (size_t)num_coords;
+  size_t max_lines = INPUT_BYTES / (16 + 4 * (size_t)num_coords) + 1;
+  input->text = (char *)malloc(capacity);
+  input->lists = (size_t *)malloc(max_lines * sizeof(size_t));
+  if (input->text == NULL || input->lists == NULL) {
+    return 1;
+  }
+
+  uint64_t state = num_coords;
+  input->len = input->num_lines = input->list_bytes = 0;
+  while (input->len < INPUT_BYTES && input->num_lines < max_lines) {
+    char *line = input->text + input->len;
+    size_t n = (size_t)sprintf(line, "RESERVE %zu [", input->num_lines % 1000 + 1);
+    input->lists[input->num_lines++] = input->len + n;
+
+    for (unsigned int c = 0; c < num_coords; c++) {
+      state = state * 6364136223846793005 + 1442695040888963407;
+      n += (size_t)sprintf(line + n, "%s(%u,%u)", c > 0 ? " " : "",
+                           (unsigned int)(state >> 33) % 1000 + 1,
+                           (unsigned int)(state >> 17) % 1000 + 1);
+    }
+    line[n++] = ']';
+    line[n++] = '\n';
+
+    input->list_bytes += n - (input->lists[input->num_lines - 1] - input->len) - 1;
+    input->len += n;
+  }
+
+  return 0;
+}
+
+/// Scans every coordinate list with scan_coords.
+/// @return Number of coordinates scanned.
+static size_t run_scan(const struct Input *input, struct Coords *coords) {
+  size_t total = 0;
+  for (size_t i = 0; i < input->num_lines; i++) {
+    size_t start = input->lists[i], consumed;
+    total += scan_coords(input->text + start, input->len - start, coords, &consumed);
+  }
+  return total;
+}
+
+/// Parses every command with get_next and parse_reserve.
+/// @return Number of coordinates parsed.
+static size_t run_parse(const struct Input *input, struct Coords *coords) {
+  struct Reader reader;
+  reader_init_mem(&reader, input->text, input->len);
+
+  size_t total = 0;
+  unsigned int event_id;
+  while (get_next(&reader) == CMD_RESERVE) {
+    total += parse_reserve(&reader, &event_id, coords);
+  }
+  return total;
+}
+
+/// Runs a pass over the input several times and prints the fastest.
+static void measure(const char *name, const struct Input *input, size_t bytes,
+                    size_t (*pass)(const struct Input *, struct Coords *), unsigned int repeat,
+                    struct Coords *coords) {
+  uint64_t best_ns = UINT64_MAX, best_cycles = 0;
+  size_t total = 0;
+
+  for (unsigned int r = 0; r < repeat; r++) {
+    uint64_t start_ns = now_ns(), start_cycles = now_cycles();
+    total = pass(input, coords);
+    uint64_t ns = now_ns() - start_ns, cycles = now_cycles() - start_cycles;
+    if (ns < best_ns) {
+      best_ns = ns;
+      best_cycles = cycles;
+    }
+  }
+
+  printf("  %-14s %9.1f MB/s %7.2f ns/B %7.2f cycles/B  (%zu seats)\n", name,
+         (double)bytes / ((double)best_ns / 1e9) / 1e6, (double)best_ns / (double)bytes,
+         (double)best_cycles / (double)bytes, total);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int sizes[] = {1, 8, 64, 512};
+  unsigned int repeat = 5;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "r:")) != -1) {
+    if (opt != 'r' || sscanf(optarg, "%u", &repeat) != 1 || repeat == 0) {
+      fprintf(stderr, "Usage: %s [-r <runs of each pass, the fastest is reported (5)>]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  printf("RESERVE_FAST_SCAN=%d, %zu MB of RESERVE commands per list length\n",
+         RESERVE_FAST_SCAN, INPUT_BYTES >> 20);
+
+  struct Coords coords = {NULL, NULL, 0};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    struct Input input;
+    if (generate(&input, sizes[s]) != 0) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      return 1;
+    }
+
+    printf("%u seats per RESERVE:\n", sizes[s]);
+    measure("scan_coords", &input, input.list_bytes, run_scan, repeat, &coords);
+    measure("parse_reserve", &input, input.len, run_parse, repeat, &coords);
+
+    free(input.text);
+    free(input.lists);
+  }
+
+  coords_destroy(&coords);
+  return 0;
+}
@@ -0,0 +1,186 @@
+/// Cost of SHOW on large events: events of 200x200, 1000x1000 and 2000x2000
+/// seats, the last two with a compact seat map, are partly reserved and then
+/// printed with ems_show to /dev/null. Reports the time of each SHOW and the
+/// bytes printed per second.
+/// @note ems_show sleeps twice for the state access delay, which is set to 0
+/// but still costs a nanosleep. The seats are reserved by many threads at once,
+/// as ems_reserve also sleeps for each seat.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "operations.h"
+#include "seatmap.h"
+
+/// Most seats of a reservation, which are consecutive seats of a row.
+#define MAX_SEATS 8
+
+/// Threads that reserve the seats.
+#define FILL_THREADS 32
+
+/// Event being printed.
+struct Grid {
+  unsigned int id;
+  unsigned int rows;
+  unsigned int cols;
+};
+
+struct Filler {
+  const struct Grid *grid;
+  unsigned int percent; /// Share of the seats to reserve.
+  unsigned int first;   /// First row of the thread, from 0.
+};
+
+/// Gets the current time.
+/// @return Nanoseconds of the monotonic clock.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/// Reserves runs of seats of every FILL_THREADS-th row, with free gaps between
+/// them sized so that about the given share of the seats is reserved.
+static void *fill_seats(void *arg) {
+  struct Filler *filler = (struct Filler *)arg;
+  const struct Grid *grid = filler->grid;
+  uint64_t state = (uint64_t)grid->id * FILL_THREADS + filler->first;
+  uint32_t xs[MAX_SEATS], ys[MAX_SEATS];
+
+  // Runs average (MAX_SEATS + 1) / 2 seats, twice the average gap is drawn from.
+  size_t max_gap = (size_t)(MAX_SEATS + 1) * (100 - filler->percent) / filler->percent;
+
+  for (uint32_t row = filler->first + 1; row <= grid->rows; row += FILL_THREADS) {
+    uint32_t col = 1;
+    while (1) {
+      state = state * 6364136223846793005 + 1442695040888963407;
+      col += (uint32_t)((state >> 33) % (max_gap + 1));
+      size_t num_seats = (size_t)(state >> 60) % MAX_SEATS + 1;
+      if (col + num_seats - 1 > grid->cols) {
+        break;
+      }
+
+      for (size_t i = 0; i < num_seats; i++) {
+        xs[i] = row;
+        ys[i] = col + (uint32_t)i;
+      }
+      ems_reserve(grid->id, num_seats, xs, ys);
+      col += (uint32_t)num_seats;
+    }
+  }
+
+  return NULL;
+}
+
+/// Reserves about the given share of the seats of an event.
+/// @return 0 on success, 1 on failure.
+static int fill(const struct Grid *grid, unsigned int percent) {
+  pthread_t threads[FILL_THREADS];
+  struct Filler fillers[FILL_THREADS];
+
+  if (percent == 0) {
+    return 0;
+  }
+
+  for (unsigned int i = 0; i < FILL_THREADS; i++) {
+    fillers[i] = (struct Filler){grid, percent, i};
+    if (pthread_create(&threads[i], NULL, fill_seats, &fillers[i]) != 0) {
+      fprintf(stderr, "Failed to create thread\n");
+      return 1;
+    }
+  }
+  for (unsigned int i = 0; i < FILL_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  return 0;
+}
+
+/// Prints an event repeatedly and reports the fastest SHOW.
+/// @return 0 on success, 1 on failure.
+static int measure(const struct Grid *grid, unsigned int repeat, int null_fd,
+                   pthread_mutex_t *mutex) {
+  // The size of the output is taken from a first SHOW to a file.
+  FILE *file = tmpfile();
+  if (file == NULL || ems_show(grid->id, fileno(file), mutex) != 0) {
+    fprintf(stderr, "Failed to show event %u\n", grid->id);
+    return 1;
+  }
+  off_t bytes = lseek(fileno(file), 0, SEEK_END);
+  fclose(file);
+
+  uint64_t best_ns = UINT64_MAX;
+  for (unsigned int r = 0; r < repeat; r++) {
+    uint64_t start = now_ns();
+    if (ems_show(grid->id, null_fd, mutex) != 0) {
+      fprintf(stderr, "Failed to show event %u\n", grid->id);
+      return 1;
+    }
+    uint64_t elapsed = now_ns() - start;
+    if (elapsed < best_ns) {
+      best_ns = elapsed;
+    }
+  }
+
+  printf("%5ux%-5u %8s %10.1f %10.2f %10.1f\n", grid->rows, grid->cols,
+         seatmap_is_compact(grid->rows, grid->cols) ? "compact" : "ids",
+         (double)bytes / (1 << 20), (double)best_ns / 1e6,
+         (double)bytes / (1 << 20) / ((double)best_ns / 1e9));
+  return 0;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -f <pct>   percent of the seats that are reserved (5)\n"
+          "  -r <runs>  SHOWs of each event, the fastest is reported (10)\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  const struct Grid grids[] = {{1, 200, 200}, {2, 1000, 1000}, {3, 2000, 2000}};
+  unsigned int percent = 5, repeat = 10;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:r:")) != -1) {
+    int fields = 0;
+    if (opt == 'f') {
+      fields = sscanf(optarg, "%u", &percent);
+    } else if (opt == 'r') {
+      fields = sscanf(optarg, "%u", &repeat);
+    }
+
+    if (fields != 1 || percent > 100 || repeat == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (null_fd < 0 || ems_init(0, LOCK_STRIPED, 0) != 0) {
+    fprintf(stderr, "Failed to initialize\n");
+    return 1;
+  }
+
+  pthread_mutex_t mutex;
+  safe_mutex_init(&mutex);
+
+  printf("about %u%% of the seats reserved, fastest of %u SHOWs\n", percent, repeat);
+  printf("%11s %8s %10s %10s %10s\n", "event", "map", "output MB", "ms/SHOW", "MB/s");
+
+  int failed = 0;
+  for (size_t g = 0; g < sizeof(grids) / sizeof(grids[0]) && !failed; g++) {
+    const struct Grid *grid = &grids[g];
+    failed = ems_create(grid->id, grid->rows, grid->cols) != 0 || fill(grid, percent) != 0 ||
+             measure(grid, repeat, null_fd, &mutex) != 0;
+  }
+
+  safe_mutex_destroy(&mutex);
+  ems_terminate();
+  close(null_fd);
+  return failed;
+}
@@ -0,0 +1,117 @@
+/// Cost of ordering the seats of a RESERVE, for 2, 16, 256 and 4096 seats:
+/// sort_seats, which also drops duplicates, against the qsort of (row, column)
+/// pairs that ems_reserve used before it.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "operations.h"
+
+/// Seats sorted for each list length, spread over as many lists as needed.
+#define SEATS_PER_SIZE ((size_t)1 << 24)
+
+/// Gets the current time.
+/// @return Nanoseconds of the monotonic clock.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static int compare_pairs(const void *a, const void *b) {
+  const size_t *x = (const size_t *)a;
+  const size_t *y = (const size_t *)b;
+
+  if (x[0] != y[0]) {
+    return x[0] < y[0] ? -1 : 1;
+  }
+  return x[1] < y[1] ? -1 : x[1] > y[1];
+}
+
+/// Sorts seats like the former sortReserve: through an array of (row, column)
+/// pairs and qsort, without dropping duplicates.
+static void sort_pairs(size_t *xs, size_t *ys, size_t (*pairs)[2], size_t num_seats) {
+  for (size_t i = 0; i < num_seats; i++) {
+    pairs[i][0] = xs[i];
+    pairs[i][1] = ys[i];
+  }
+
+  qsort(pairs, num_seats, sizeof(pairs[0]), compare_pairs);
+
+  for (size_t i = 0; i < num_seats; i++) {
+    xs[i] = pairs[i][0];
+    ys[i] = pairs[i][1];
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t sizes[] = {2, 16, 256, 4096};
+  unsigned int rows = 1000, cols = 1000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "g:")) != -1) {
+    if (opt != 'g' || sscanf(optarg, "%ux%u", &rows, &cols) != 2 || rows == 0 || cols == 0) {
+      fprintf(stderr, "Usage: %s [-g <rows>x<cols> of the event (1000x1000)]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  size_t num_event_seats = (size_t)rows * cols;
+  size_t *input = (size_t *)malloc(SEATS_PER_SIZE * sizeof(size_t));
+  size_t *seats = (size_t *)malloc(2 * sizes[3] * sizeof(size_t));
+  size_t *xs = (size_t *)malloc(2 * sizes[3] * sizeof(size_t));
+  size_t(*pairs)[2] = (size_t(*)[2])malloc(sizes[3] * sizeof(size_t[2]));
+  if (input == NULL || seats == NULL || xs == NULL || pairs == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 1;
+  }
+  size_t *ys = xs + sizes[3];
+
+  uint64_t state = 1;
+  for (size_t i = 0; i < SEATS_PER_SIZE; i++) {
+    state = state * 6364136223846793005 + 1442695040888963407;
+    input[i] = (size_t)(state >> 24) % num_event_seats;
+  }
+
+  printf("%ux%u event, %zu seats sorted per list length\n", rows, cols, SEATS_PER_SIZE);
+  printf("%6s %14s %14s %9s %10s\n", "seats", "sort_seats ns", "qsort ns", "speedup",
+         "distinct");
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t n = sizes[s];
+    size_t num_lists = SEATS_PER_SIZE / n;
+    size_t distinct = 0;
+
+    uint64_t start = now_ns();
+    for (size_t l = 0; l < num_lists; l++) {
+      for (size_t i = 0; i < n; i++) {
+        seats[i] = input[l * n + i];
+      }
+      distinct += sort_seats(seats, seats + n, n, num_event_seats);
+    }
+    uint64_t radix_ns = now_ns() - start;
+
+    start = now_ns();
+    for (size_t l = 0; l < num_lists; l++) {
+      for (size_t i = 0; i < n; i++) {
+        xs[i] = input[l * n + i] / cols + 1;
+        ys[i] = input[l * n + i] % cols + 1;
+      }
+      sort_pairs(xs, ys, pairs, n);
+    }
+    uint64_t qsort_ns = now_ns() - start;
+
+    printf("%6zu %14.1f %14.1f %8.1fx %10.4f\n", n, (double)radix_ns / (double)num_lists,
+           (double)qsort_ns / (double)num_lists, (double)qsort_ns / (double)radix_ns,
+           (double)distinct / (double)(num_lists * n));
+  }
+
+  free(pairs);
+  free(xs);
+  free(seats);
+  free(input);
+  return 0;
+}
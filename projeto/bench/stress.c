@@ -0,0 +1,262 @@
+/// Stress test of ems_reserve: threads reserve random, overlapping sets of seats
+/// of one event at the same time, then the seats are read back with ems_show to
+/// check that every reservation was all-or-nothing.
+/// @note Run by make check for every lock mode. The conflicts are expected, so
+/// the "Seat already reserved" errors can be sent to /dev/null.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "operations.h"
+
+/// Most seats of a reservation. Seats may repeat, which ems_reserve merges.
+#define MAX_SEATS 8
+
+/// Reservation attempted by a thread.
+struct Attempt {
+  uint32_t xs[MAX_SEATS];
+  uint32_t ys[MAX_SEATS];
+  size_t num_seats;
+  int reserved; /// 1 if ems_reserve succeeded.
+};
+
+/// Parameters of the test.
+struct Stress {
+  unsigned int threads;  /// Threads reserving at the same time.
+  unsigned int rounds;   /// Reservations attempted by each thread.
+  unsigned int rows;     /// Rows of the event.
+  unsigned int cols;     /// Columns of the event.
+  unsigned int hot;      /// The seats are picked among the first hot ones.
+  struct Attempt *attempts;
+};
+
+struct Worker {
+  struct Stress *stress;
+  unsigned int id;
+};
+
+/// Gets the next number of the splitmix64 sequence.
+static uint64_t next_random(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+static void *reserve_seats(void *arg) {
+  struct Worker *worker = (struct Worker *)arg;
+  struct Stress *stress = worker->stress;
+  uint64_t state = worker->id + 1;
+
+  for (unsigned int r = 0; r < stress->rounds; r++) {
+    struct Attempt *attempt = &stress->attempts[(size_t)worker->id * stress->rounds + r];
+    attempt->num_seats = (size_t)(next_random(&state) % MAX_SEATS) + 1;
+    for (size_t i = 0; i < attempt->num_seats; i++) {
+      unsigned int seat = (unsigned int)(next_random(&state) % stress->hot);
+      attempt->xs[i] = seat / stress->cols + 1;
+      attempt->ys[i] = seat % stress->cols + 1;
+    }
+    attempt->reserved = ems_reserve(1, attempt->num_seats, attempt->xs, attempt->ys) == 0;
+  }
+
+  return NULL;
+}
+
+/// Reads the seats of the event back with ems_show.
+/// @return Array of rows * cols reservation ids, NULL on failure.
+static unsigned int *read_seats(const struct Stress *stress) {
+  size_t num_seats = (size_t)stress->rows * stress->cols;
+  unsigned int *seats = (unsigned int *)malloc(num_seats * sizeof(unsigned int));
+  FILE *file = tmpfile();
+  if (seats == NULL || file == NULL) {
+    fprintf(stderr, "Failed to read the seats back\n");
+    free(seats);
+    return NULL;
+  }
+
+  pthread_mutex_t mutex;
+  safe_mutex_init(&mutex);
+  int failed = ems_show(1, fileno(file), &mutex);
+  safe_mutex_destroy(&mutex);
+
+  rewind(file);
+  for (size_t i = 0; i < num_seats && !failed; i++) {
+    failed = fscanf(file, "%u", &seats[i]) != 1;
+  }
+  fclose(file);
+
+  if (failed) {
+    fprintf(stderr, "Failed to read the seats back\n");
+    free(seats);
+    return NULL;
+  }
+
+  return seats;
+}
+
+/// Checks that each successful reservation holds all of its seats under an id of
+/// its own, and that no other seat is taken.
+/// @return 0 if the seats are consistent, 1 otherwise.
+static int check_seats(const struct Stress *stress, const unsigned int *seats) {
+  size_t num_attempts = (size_t)stress->threads * stress->rounds;
+  size_t num_seats = (size_t)stress->rows * stress->cols;
+  // Ids are never above the number of attempts, failed ones are given back or skipped.
+  unsigned char *id_used = (unsigned char *)calloc(num_attempts + 1, 1);
+  if (id_used == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 1;
+  }
+
+  size_t reserved = 0, expected = 0;
+  int failed = 0;
+
+  for (size_t a = 0; a < num_attempts && !failed; a++) {
+    const struct Attempt *attempt = &stress->attempts[a];
+    if (!attempt->reserved) {
+      continue;
+    }
+    reserved++;
+
+    unsigned int id = seats[(attempt->xs[0] - 1) * stress->cols + attempt->ys[0] - 1];
+    if (id == 0 || id > num_attempts || id_used[id]) {
+      fprintf(stderr, "Reservation %zu has id %u, which is not its own\n", a, id);
+      failed = 1;
+      break;
+    }
+    id_used[id] = 1;
+
+    for (size_t i = 0; i < attempt->num_seats; i++) {
+      size_t seat = (attempt->xs[i] - 1) * stress->cols + attempt->ys[i] - 1;
+      if (seats[seat] != id) {
+        fprintf(stderr, "Reservation %zu has seat %zu under id %u instead of %u\n", a, seat,
+                seats[seat], id);
+        failed = 1;
+        break;
+      }
+
+      // Counts each seat once, even if the reservation listed it several times.
+      int repeated = 0;
+      for (size_t j = 0; j < i; j++) {
+        repeated |= attempt->xs[j] == attempt->xs[i] && attempt->ys[j] == attempt->ys[i];
+      }
+      expected += !repeated;
+    }
+  }
+
+  size_t occupied = 0;
+  for (size_t i = 0; i < num_seats; i++) {
+    occupied += seats[i] != 0;
+  }
+
+  if (!failed && occupied != expected) {
+    fprintf(stderr, "%zu seats are taken, the reservations made %zu\n", occupied, expected);
+    failed = 1;
+  }
+
+  printf("%zu of %zu reservations made, %zu seats taken: %s\n", reserved, num_attempts, occupied,
+         failed ? "FAILED" : "ok");
+
+  free(id_used);
+  return failed;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s <row|striped|atomic> [options]\n"
+          "  -t <threads>       threads reserving at the same time (64)\n"
+          "  -n <reservations>  reservations attempted by each thread (200)\n"
+          "  -g <rows>x<cols>   size of the event (64x64)\n"
+          "  -w <seats>         only the first seats are picked, all by default\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  struct Stress stress = {64, 200, 64, 64, 0, NULL};
+
+  if (argc < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  enum LockMode mode;
+  if (strcmp(argv[1], "row") == 0) {
+    mode = LOCK_ROW;
+  } else if (strcmp(argv[1], "striped") == 0) {
+    mode = LOCK_STRIPED;
+  } else if (strcmp(argv[1], "atomic") == 0) {
+    mode = LOCK_ATOMIC;
+  } else {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (int i = 2; i + 1 < argc; i += 2) {
+    int fields = 0;
+    if (strcmp(argv[i], "-t") == 0) {
+      fields = sscanf(argv[i + 1], "%u", &stress.threads);
+    } else if (strcmp(argv[i], "-n") == 0) {
+      fields = sscanf(argv[i + 1], "%u", &stress.rounds);
+    } else if (strcmp(argv[i], "-g") == 0) {
+      fields = sscanf(argv[i + 1], "%ux%u", &stress.rows, &stress.cols) == 2;
+    } else if (strcmp(argv[i], "-w") == 0) {
+      fields = sscanf(argv[i + 1], "%u", &stress.hot);
+    }
+
+    if (fields != 1) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  unsigned int num_seats = stress.rows * stress.cols;
+  if (stress.hot == 0 || stress.hot > num_seats) {
+    stress.hot = num_seats;
+  }
+  if (stress.threads == 0 || num_seats == 0 || (argc - 2) % 2 != 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (ems_init(0, mode, 0) != 0 || ems_create(1, stress.rows, stress.cols) != 0) {
+    fprintf(stderr, "Failed to create the event\n");
+    return 1;
+  }
+
+  stress.attempts = (struct Attempt *)calloc((size_t)stress.threads * stress.rounds,
+                                             sizeof(struct Attempt));
+  pthread_t *threads = (pthread_t *)malloc(stress.threads * sizeof(pthread_t));
+  struct Worker *workers = (struct Worker *)malloc(stress.threads * sizeof(struct Worker));
+  if (stress.attempts == NULL || threads == NULL || workers == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 1;
+  }
+
+  printf("stress %s: %u threads, %u reservations each, %ux%u seats, %u hot: ", argv[1],
+         stress.threads, stress.rounds, stress.rows, stress.cols, stress.hot);
+  fflush(stdout);
+
+  for (unsigned int i = 0; i < stress.threads; i++) {
+    workers[i] = (struct Worker){&stress, i};
+    if (pthread_create(&threads[i], NULL, reserve_seats, &workers[i]) != 0) {
+      fprintf(stderr, "Failed to create thread\n");
+      return 1;
+    }
+  }
+  for (unsigned int i = 0; i < stress.threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  unsigned int *seats = read_seats(&stress);
+  int failed = seats == NULL || check_seats(&stress, seats) != 0;
+
+  free(seats);
+  free(workers);
+  free(threads);
+  free(stress.attempts);
+  ems_terminate();
+
+  return failed;
+}
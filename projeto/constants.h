@@ -1,3 +1,23 @@
-#define MAX_RESERVATION_SIZE 256
 #define STATE_ACCESS_DELAY_MS 10
-#define DT_REG 8  // Indicates a regular file
+#define READER_BUFFER_SIZE (1 << 20)  // Bytes read from a .jobs file per refill
+#ifndef RESERVE_FAST_SCAN
+#define RESERVE_FAST_SCAN 1  // Scans RESERVE coordinate lists 32 bytes at a time, 0 to parse them byte by byte
+#endif
+#define JOBS_MMAP 1  // Maps .jobs files into memory so that threads parse without a lock (0 to disable)
+#ifndef JOBS_LARGEST_FIRST
+#define JOBS_LARGEST_FIRST 1  // Runs the .jobs files by decreasing size, 0 for directory order
+#endif
+#define JOBS_SCHEDULER 0  // 1 to run all .jobs files in one work-stealing pool instead of one process per file
+#define JOBS_PARTITIONED 0  // 1 to split each segment between the threads by event, for reproducible .out files
+#define JOBS_SHARDED 0  // 1 to route the commands to the threads by event, with lock-free seats
+#define SHARD_RING_SIZE 1024  // Commands queued per thread in sharded mode, a power of two
+#define SEAT_LOCK_MODE LOCK_STRIPED  // Seat locking: LOCK_ROW, LOCK_STRIPED or LOCK_ATOMIC (see seatlock.h)
+#define SEAT_LOCK_STRIPES 64  // Number of locks per event in LOCK_STRIPED mode
+#define SEAT_MAP_COMPACT_MIN ((size_t)1 << 16)  // Events with at least this many seats keep runs of ids instead of one id per seat
+#define SEAT_MAP_COMPACT_MIN_COLS 256  // Compact events also need rows of at least this many seats, as each compact row costs a row lock
+#define EMS_SHARED_STATE 0  // 1 to share the events between the processes of all .jobs files
+#define EMS_ARENA_SIZE ((size_t)1 << 30)  // Maximum size of the shared EMS state, in bytes
+#define ARENA_CHUNK_SIZE ((size_t)1 << 24)  // Bytes a private arena takes from the system at a time
+#ifndef EMS_METRICS
+#define EMS_METRICS 0  // 1 to time the commands and locks of each .jobs file into a .stats file (see metrics.h)
+#endif
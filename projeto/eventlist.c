@@ -1,81 +1,167 @@
 #include "eventlist.h"
 #include "operations.h"
+#include "seatlock.h"
 
-#include <stdlib.h>
 #include <pthread.h>
 
-struct EventList *create_list() {
-  struct EventList *list = (struct EventList *)malloc(sizeof(struct EventList));
+#define INITIAL_CAPACITY 64
+
+/// Hashes an event id (Fibonacci hashing).
+/// @param event_id Event id.
+/// @param capacity Capacity of the table, a power of two.
+/// @return First slot to probe.
+static size_t slot_of(unsigned int event_id, size_t capacity) {
+  return (size_t)(event_id * 2654435761u) & (capacity - 1);
+}
+
+static struct EventTable *create_table(struct Arena *arena, size_t capacity) {
+  struct EventTable *table = (struct EventTable *)arena_alloc(arena,
+      sizeof(struct EventTable) + capacity * sizeof(_Atomic(struct Event *)));
+  if (!table)
+    return NULL;
+
+  table->capacity = capacity;
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&table->slots[i], NULL);
+  }
+  return table;
+}
+
+static void insert_into_table(struct EventTable *table, struct Event *event) {
+  size_t i = slot_of(event->id, table->capacity);
+  while (atomic_load_explicit(&table->slots[i], memory_order_relaxed) != NULL) {
+    i = (i + 1) & (table->capacity - 1);
+  }
+
+  // Release so that readers that find the event also see its contents.
+  atomic_store_explicit(&table->slots[i], event, memory_order_release);
+}
+
+struct EventList *create_list(struct Arena *arena) {
+  struct EventList *list = (struct EventList *)arena_alloc(arena, sizeof(struct EventList));
   if (!list)
     return NULL;
-  list->head = NULL;
-  list->tail = NULL;
+
+  struct EventTable *table = create_table(arena, INITIAL_CAPACITY);
+  struct Event **events = (struct Event **)arena_alloc(arena, INITIAL_CAPACITY * sizeof(struct Event *));
+  if (!table || !events) {
+    return NULL;
+  }
+
+  list->arena = arena;
+  if (arena->shared) {
+    safe_mutex_init_shared(&list->lock);
+  } else {
+    safe_mutex_init(&list->lock);
+  }
+
+  atomic_init(&list->table, table);
+  atomic_init(&list->events, events);
+  atomic_init(&list->size, 0);
+  list->capacity = INITIAL_CAPACITY;
   return list;
 }
 
-int append_to_list(struct EventList *list, struct Event *event, pthread_rwlock_t *rwlock_events) {
-  if (!list)
-    return 1;
+/// Makes room for one more event, growing the table and the events array.
+/// @note Old copies are never freed, since lock-free readers may still be
+/// using them. They are released with the arena.
+/// @param list Event list to be modified.
+/// @return 0 on success, 1 otherwise.
+static int reserve_slot(struct EventList *list) {
+  size_t size = atomic_load_explicit(&list->size, memory_order_relaxed);
+  struct Event **events = atomic_load_explicit(&list->events, memory_order_relaxed);
+
+  if (size == list->capacity) {
+    struct Event **new_events =
+        (struct Event **)arena_alloc(list->arena, 2 * list->capacity * sizeof(struct Event *));
+    if (!new_events)
+      return 1;
+
+    for (size_t i = 0; i < size; i++) {
+      new_events[i] = events[i];
+    }
 
-  struct ListNode *new_node =
-      (struct ListNode *)malloc(sizeof(struct ListNode));
-  if (!new_node)
-    return 1;
+    list->capacity *= 2;
+    atomic_store_explicit(&list->events, new_events, memory_order_release);
+    events = new_events;
+  }
 
-  new_node->event = event;
-  new_node->next = NULL;
+  // Keeps the load factor of the table under 1/2 so that probes stay short.
+  struct EventTable *table = atomic_load_explicit(&list->table, memory_order_relaxed);
+  if (2 * (size + 1) > table->capacity) {
+    struct EventTable *new_table = create_table(list->arena, 2 * table->capacity);
+    if (!new_table)
+      return 1;
 
-  // Write lock so that no other thread can modify the list concurrently.
-  safe_rwlock_wrlock(rwlock_events);
-  if (list->head == NULL) {
-    list->head = new_node;
-    list->tail = new_node;
-  } else {
-    list->tail->next = new_node;
-    list->tail = new_node;
+    for (size_t i = 0; i < size; i++) {
+      insert_into_table(new_table, events[i]);
+    }
+
+    atomic_store_explicit(&list->table, new_table, memory_order_release);
   }
-  safe_rwlock_unlock(rwlock_events);
 
   return 0;
 }
 
-static void free_event(struct Event *event) {
-  if (!event)
-    return;
+int append_to_list(struct EventList *list, struct Event *event) {
+  if (!list)
+    return 1;
 
-  free(event->data);
-  free(event);
+  // Lock so that no other thread (or process, for a shared list) can modify the list concurrently.
+  safe_mutex_lock(&list->lock);
+  if (get_event(list, event->id) != NULL || reserve_slot(list) != 0) {
+    safe_mutex_unlock(&list->lock);
+    return 1;
+  }
+
+  size_t size = atomic_load_explicit(&list->size, memory_order_relaxed);
+  struct Event **events = atomic_load_explicit(&list->events, memory_order_relaxed);
+  events[size] = event;
+  insert_into_table(atomic_load_explicit(&list->table, memory_order_relaxed), event);
+  atomic_store_explicit(&list->size, size + 1, memory_order_release);
+  safe_mutex_unlock(&list->lock);
+
+  return 0;
 }
 
 void free_list(struct EventList *list) {
   if (!list)
     return;
 
-  struct ListNode *current = list->head;
-  while (current) {
-    struct ListNode *temp = current;
-    current = current->next;
-
-    free_event(temp->event);
-    free(temp);
+  struct Event **events = atomic_load(&list->events);
+  size_t size = atomic_load(&list->size);
+  for (size_t i = 0; i < size; i++) {
+    seatlock_destroy(events[i]);
   }
 
-  free(list);
+  safe_mutex_destroy(&list->lock);
 }
 
 struct Event *get_event(struct EventList *list, unsigned int event_id) {
   if (!list)
     return NULL;
 
-  // Read lock so that multiple threads can read from the list at the same time.
-  struct ListNode *current = list->head;
-  while (current) {
-    struct Event *event = current->event;
+  // No lock is needed: tables are never modified in place except for filling
+  // empty slots, and replaced tables are kept alive until the arena is destroyed.
+  struct EventTable *table = atomic_load_explicit(&list->table, memory_order_acquire);
+  size_t i = slot_of(event_id, table->capacity);
+  struct Event *event;
+  while ((event = atomic_load_explicit(&table->slots[i], memory_order_acquire)) != NULL) {
     if (event->id == event_id) {
       return event;
     }
-    current = current->next;
+    i = (i + 1) & (table->capacity - 1);
   }
 
   return NULL;
 }
+
+size_t list_size(struct EventList *list) {
+  return atomic_load_explicit(&list->size, memory_order_acquire);
+}
+
+struct Event *list_at(struct EventList *list, size_t index) {
+  // Any events array loaded after the size holds at least size events.
+  struct Event **events = atomic_load_explicit(&list->events, memory_order_acquire);
+  return events[index];
+}
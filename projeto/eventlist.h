@@ -1,55 +1,91 @@
 #ifndef EVENT_LIST_H
 #define EVENT_LIST_H
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <pthread.h>
 
+#include "arena.h"
+#include "seatlock.h"
+#include "seatmap.h"
+
+// An event is a single arena block: this header, then its seats, then its locks.
 struct Event {
+  size_t block_size;         /// Size of the block holding the event.
   unsigned int id;           /// Event id
-  unsigned int reservations; /// Number of reservations for the event.
+  atomic_uint reservations;  /// Number of reservations for the event, also the last id given.
 
   size_t cols; /// Number of columns.
   size_t rows; /// Number of rows.
 
-  unsigned int
-      *data; /// Array of size rows * cols with the reservations for each seat.
-  
-  pthread_rwlock_t 
-      *locks; /// Array of size rows * cols with the locks for each seat.
+  atomic_uint
+      *data; /// Array of size rows * cols with the reservations for each seat, NULL for a compact seat map.
+  _Atomic uint64_t *occupied;   /// One bit per seat, set for reserved seats (see seatmap.h).
+  struct SeatRow *seat_rows;    /// Compact seat map: runs of reserved seats of each row.
+  atomic_size_t reserved_seats; /// Number of reserved seats.
+  atomic_size_t *row_reserved;  /// Number of reserved seats of each row.
+
+  enum LockMode lock_mode; /// How the seats are protected.
+  size_t num_locks;        /// Number of locks, 0 in LOCK_ATOMIC mode.
+  pthread_rwlock_t
+      *locks; /// Array of num_locks locks that cover the seats (see seatlock.h).
+  atomic_uint writers; /// Reservations in progress, only used in LOCK_ATOMIC mode.
+  atomic_uint version; /// Reservations finished, only used in LOCK_ATOMIC mode.
+  atomic_uint blocked; /// Snapshots holding back new reservations, only used in LOCK_ATOMIC mode.
+  pthread_mutex_t gate;        /// Protects waiting on writers and blocked, only used in LOCK_ATOMIC mode.
+  pthread_cond_t gate_changed; /// Signaled when writers or blocked drop, only used in LOCK_ATOMIC mode.
 };
 
-struct ListNode {
-  struct Event *event;
-  struct ListNode *next;
+// Open-addressing hash table of events, indexed by event id.
+struct EventTable {
+  size_t capacity;                  // Number of slots, a power of two
+  _Atomic(struct Event *) slots[];  // Events, NULL for empty slots
 };
 
-// Linked list structure
+// Event store with lock-free lookups. Writers are serialized by the list lock.
 struct EventList {
-  struct ListNode *head; // Head of the list
-  struct ListNode *tail; // Tail of the list
+  struct Arena *arena;                // Arena the list and its events live in
+  pthread_mutex_t lock;               // Serializes writers
+  _Atomic(struct EventTable *) table; // Index of the events by id
+  _Atomic(struct Event **) events;    // Events in insertion order
+  atomic_size_t size;                 // Number of events
+  size_t capacity;                    // Capacity of the events array
 };
 
 /// Creates a new event list.
+/// @param arena Arena to allocate the list and its events from. If the arena
+/// is shared, so is the list lock.
 /// @return Newly created event list, NULL on failure
-struct EventList *create_list();
+struct EventList *create_list(struct Arena *arena);
 
-/// Appends a new node to the list.
+/// Appends a new event to the list.
 /// @param list Event list to be modified.
-/// @param data Event to be stored in the new node.
-/// @param rwlock_events RWLock to be used to access the events list.
-/// @return 0 if the node was appended successfully, 1 otherwise.
-int append_to_list(struct EventList *list, struct Event *data, pthread_rwlock_t *rwlock_events);
+/// @param data Event to be stored, allocated from the arena of the list.
+/// @return 0 if the event was appended successfully, 1 otherwise (including
+/// when an event with the same id already exists).
+int append_to_list(struct EventList *list, struct Event *data);
 
-/// Removes a node from the list.
-/// @param list Event list to be modified.
-/// @return 0 if the node was removed successfully, 1 otherwise.
+/// Destroys the locks of the list and of all its events. Their memory is only
+/// released with the arena.
+/// @param list Event list to be destroyed.
 void free_list(struct EventList *list);
 
 /// Retrieves an event in the list.
+/// @note Does not lock, it can run concurrently with append_to_list.
 /// @param list Event list to be searched
 /// @param event_id Event id.
-/// @param rwlock_events RWLock to be used to access the events list.
 /// @return Pointer to the event if found, NULL otherwise.
 struct Event *get_event(struct EventList *list, unsigned int event_id);
 
+/// Returns the number of events in the list.
+/// @param list Event list.
+/// @return Number of events.
+size_t list_size(struct EventList *list);
+
+/// Retrieves an event by its insertion order.
+/// @param list Event list.
+/// @param index Position of the event, smaller than list_size.
+/// @return Pointer to the event.
+struct Event *list_at(struct EventList *list, size_t index);
+
 #endif // EVENT_LIST_H
@@ -0,0 +1,508 @@
+#include "jobsbin.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobsmap.h"
+#include "operations.h"
+#include "reader.h"
+
+#define HEADER_SIZE (4 + 1 + 8 + 8)
+#define VARINT_MAX 10 // Bytes of the longest varint of a 64-bit value
+
+enum Opcode {
+  OP_CREATE = 1,
+  OP_RESERVE,
+  OP_SHOW,
+  OP_LIST,
+  OP_BARRIER,
+  OP_WAIT,
+  OP_HELP,
+  OP_INVALID,
+  OP_RESERVE_BEST,
+  OP_STATS,
+};
+
+/// Appends an opcode to the compiled commands.
+/// @param out Compiled commands.
+/// @param opcode Opcode to be appended.
+/// @return 0 if the opcode was appended successfully, 1 otherwise.
+static int put_opcode(struct OutBuffer *out, enum Opcode opcode) {
+  char byte = (char)opcode;
+  return outbuffer_append(out, &byte, 1);
+}
+
+/// Appends a LEB128 varint to the compiled commands.
+/// @param out Compiled commands.
+/// @param value Value to be appended.
+/// @return 0 if the value was appended successfully, 1 otherwise.
+static int put_varint(struct OutBuffer *out, uint64_t value) {
+  char bytes[VARINT_MAX];
+  size_t len = 0;
+
+  do {
+    unsigned char byte = value & 0x7f;
+    value >>= 7;
+    bytes[len++] = (char)(value != 0 ? byte | 0x80 : byte);
+  } while (value != 0);
+
+  return outbuffer_append(out, bytes, len);
+}
+
+/// Stores a little-endian 64-bit integer.
+/// @param dst Destination of the 8 bytes.
+/// @param value Value to be stored.
+static void put_u64(char *dst, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    dst[i] = (char)(value >> (8 * i));
+  }
+}
+
+/// Loads a little-endian 64-bit integer.
+/// @param src Source of the 8 bytes.
+/// @return Value loaded.
+static uint64_t get_u64(const char *src) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value |= (uint64_t)(unsigned char)src[i] << (8 * i);
+  }
+  return value;
+}
+
+/// Reads a LEB128 varint.
+/// @param reader Reader to read from.
+/// @param value Pointer to the variable to store the value in.
+/// @return 0 if the value was read successfully, 1 otherwise.
+static int read_varint(struct Reader *reader, uint64_t *value) {
+  uint64_t result = 0;
+
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    int ch = reader_getc(reader);
+    if (ch == READER_EOF) {
+      return 1;
+    }
+
+    result |= (uint64_t)(ch & 0x7f) << shift;
+    if ((ch & 0x80) == 0) {
+      *value = result;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/// Reads a varint that must fit in an unsigned int.
+/// @param reader Reader to read from.
+/// @param value Pointer to the variable to store the value in.
+/// @return 0 if the value was read successfully, 1 otherwise.
+static int read_varint_uint(struct Reader *reader, unsigned int *value) {
+  uint64_t result;
+  if (read_varint(reader, &result) != 0 || result > UINT_MAX) {
+    return 1;
+  }
+
+  *value = (unsigned int)result;
+  return 0;
+}
+
+/// Reads a varint that must fit in a size_t.
+/// @param reader Reader to read from.
+/// @param value Pointer to the variable to store the value in.
+/// @return 0 if the value was read successfully, 1 otherwise.
+static int read_varint_size(struct Reader *reader, size_t *value) {
+  uint64_t result;
+  if (read_varint(reader, &result) != 0 || result > SIZE_MAX) {
+    return 1;
+  }
+
+  *value = (size_t)result;
+  return 0;
+}
+
+/// Skips a number of varints.
+/// @param reader Reader to read from.
+/// @param count Number of varints to skip.
+/// @return 0 if the varints were skipped, 1 if the input ended first.
+static int skip_varints(struct Reader *reader, uint64_t count) {
+  uint64_t value;
+  for (uint64_t i = 0; i < count; i++) {
+    if (read_varint(reader, &value) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Gets the size of a compiled command.
+/// @param data Start of the command.
+/// @param avail Number of bytes until the end of the file.
+/// @return Size of the command in bytes, 0 if it is malformed.
+static size_t command_size(char *data, size_t avail) {
+  struct Reader reader;
+  reader_init_mem(&reader, data, avail);
+
+  uint64_t num_seats;
+  int failed = 0;
+
+  switch (reader_getc(&reader)) {
+  case OP_CREATE:
+    failed = skip_varints(&reader, 3);
+    break;
+  case OP_RESERVE:
+    failed = skip_varints(&reader, 1) || read_varint(&reader, &num_seats) ||
+             num_seats > avail || skip_varints(&reader, 2 * num_seats);
+    break;
+  case OP_RESERVE_BEST:
+    failed = skip_varints(&reader, 3);
+    break;
+  case OP_SHOW:
+  case OP_STATS:
+    failed = skip_varints(&reader, 1);
+    break;
+  case OP_WAIT:
+    failed = skip_varints(&reader, 2);
+    break;
+  case OP_LIST:
+  case OP_BARRIER:
+  case OP_HELP:
+  case OP_INVALID:
+    break;
+  default:
+    failed = 1;
+  }
+
+  return failed ? 0 : reader.pos;
+}
+
+int jobsbin_compile(int jobs_fd, int out_fd) {
+  struct Reader reader;
+  if (reader_init(&reader, jobs_fd) != 0) {
+    return 1;
+  }
+
+  struct OutBuffer commands = {NULL, 0, 0};
+  struct OutBuffer barriers = {NULL, 0, 0};
+  uint64_t num_commands = 0;
+  int failed = 0;
+  int done = 0;
+
+  struct Coords coords = {NULL, NULL, 0};
+
+  while (!done && !failed) {
+    unsigned int event_id, delay, thread_id = 0;
+    size_t num_rows, num_columns, num_coords, num_seats, row_hint;
+    char index[8];
+    int wait, stats;
+
+    enum Command command = get_next(&reader);
+    switch (command) {
+    case CMD_CREATE:
+      if (parse_create(&reader, &event_id, &num_rows, &num_columns) != 0) {
+        failed = put_opcode(&commands, OP_INVALID);
+        break;
+      }
+      failed = put_opcode(&commands, OP_CREATE) || put_varint(&commands, event_id) ||
+               put_varint(&commands, num_rows) || put_varint(&commands, num_columns);
+      break;
+
+    case CMD_RESERVE:
+      num_coords = parse_reserve(&reader, &event_id, &coords);
+      if (num_coords == 0) {
+        failed = put_opcode(&commands, OP_INVALID);
+        break;
+      }
+      failed = put_opcode(&commands, OP_RESERVE) || put_varint(&commands, event_id) ||
+               put_varint(&commands, num_coords);
+      for (size_t i = 0; !failed && i < num_coords; i++) {
+        failed = put_varint(&commands, coords.xs[i]) || put_varint(&commands, coords.ys[i]);
+      }
+      break;
+
+    case CMD_RESERVE_BEST:
+      if (parse_reserve_best(&reader, &event_id, &num_seats, &row_hint) != 0) {
+        failed = put_opcode(&commands, OP_INVALID);
+        break;
+      }
+      failed = put_opcode(&commands, OP_RESERVE_BEST) || put_varint(&commands, event_id) ||
+               put_varint(&commands, num_seats) || put_varint(&commands, row_hint);
+      break;
+
+    case CMD_SHOW:
+      if (parse_show(&reader, &event_id) != 0) {
+        failed = put_opcode(&commands, OP_INVALID);
+        break;
+      }
+      failed = put_opcode(&commands, OP_SHOW) || put_varint(&commands, event_id);
+      break;
+
+    case CMD_LIST_EVENTS:
+      failed = put_opcode(&commands, OP_LIST);
+      break;
+
+    case CMD_STATS:
+      stats = parse_stats(&reader, &event_id);
+      if (stats == -1) {
+        failed = put_opcode(&commands, OP_INVALID);
+        break;
+      }
+      failed = put_opcode(&commands, OP_STATS) ||
+               put_varint(&commands, stats == 1 ? (uint64_t)event_id + 1 : 0);
+      break;
+
+    case CMD_WAIT:
+      wait = parse_wait(&reader, &delay, &thread_id);
+      if (wait == -1) {
+        failed = put_opcode(&commands, OP_INVALID);
+        break;
+      }
+      failed = put_opcode(&commands, OP_WAIT) || put_varint(&commands, delay) ||
+               put_varint(&commands, wait == 1 ? (uint64_t)thread_id + 1 : 0);
+      break;
+
+    case CMD_HELP:
+      failed = put_opcode(&commands, OP_HELP);
+      break;
+
+    case CMD_BARRIER:
+      // The text parser leaves the BARRIER for the other threads to see.
+      cleanup(&reader);
+      put_u64(index, num_commands);
+      failed = outbuffer_append(&barriers, index, sizeof(index)) ||
+               put_opcode(&commands, OP_BARRIER);
+      break;
+
+    case CMD_INVALID:
+      failed = put_opcode(&commands, OP_INVALID);
+      break;
+
+    case CMD_EMPTY:
+      break;
+
+    case EOC:
+      done = 1;
+      break;
+    }
+
+    if (command != CMD_EMPTY && command != EOC) {
+      num_commands++;
+    }
+  }
+
+  char header[HEADER_SIZE];
+  memcpy(header, JOBSBIN_MAGIC, 4);
+  header[4] = JOBSBIN_VERSION;
+  put_u64(header + 5, num_commands);
+  put_u64(header + 13, barriers.len / 8);
+
+  if (!failed) {
+    failed = write_all(out_fd, header, sizeof(header)) ||
+             write_all(out_fd, barriers.data, barriers.len) ||
+             write_all(out_fd, commands.data, commands.len);
+  }
+
+  free(commands.data);
+  free(barriers.data);
+  coords_destroy(&coords);
+  reader_destroy(&reader);
+
+  return failed;
+}
+
+int jobsbin_is_compiled(const char *data, size_t size) {
+  return size >= HEADER_SIZE && memcmp(data, JOBSBIN_MAGIC, 4) == 0 &&
+         data[4] == JOBSBIN_VERSION;
+}
+
+int jobsbin_index(struct JobsMap *map) {
+  if (!jobsbin_is_compiled(map->data, map->size)) {
+    return 1;
+  }
+
+  uint64_t num_commands = get_u64(map->data + 5);
+  uint64_t num_barriers = get_u64(map->data + 13);
+  size_t offset = HEADER_SIZE;
+
+  // Every command takes at least one byte, which also bounds the allocations.
+  if (num_barriers > (map->size - offset) / 8 ||
+      num_commands > map->size - offset - num_barriers * 8) {
+    return 1;
+  }
+
+  map->barriers = (size_t *)safe_malloc((num_barriers > 0 ? num_barriers : 1) * sizeof(size_t));
+  map->num_barriers = (size_t)num_barriers;
+  for (size_t i = 0; i < map->num_barriers; i++, offset += 8) {
+    map->barriers[i] = (size_t)get_u64(map->data + offset);
+  }
+
+  map->lines = (size_t *)safe_malloc((num_commands > 0 ? num_commands : 1) * sizeof(size_t));
+  for (map->num_lines = 0; map->num_lines < num_commands; map->num_lines++) {
+    size_t size = offset < map->size ? command_size(map->data + offset, map->size - offset) : 0;
+    if (size == 0) {
+      return 1;
+    }
+
+    map->lines[map->num_lines] = offset;
+    offset += size;
+  }
+
+  // The table must list exactly the BARRIERs, in order.
+  size_t next = 0;
+  for (size_t i = 0; i < map->num_lines; i++) {
+    int is_barrier = map->data[map->lines[i]] == OP_BARRIER;
+    if (is_barrier != (next < map->num_barriers && map->barriers[next] == i)) {
+      return 1;
+    }
+    next += (size_t)is_barrier;
+  }
+
+  return 0;
+}
+
+static enum Command binary_get_next(struct Reader *reader) {
+  switch (reader_getc(reader)) {
+  case READER_EOF:
+    return EOC;
+  case OP_CREATE:
+    return CMD_CREATE;
+  case OP_RESERVE:
+    return CMD_RESERVE;
+  case OP_RESERVE_BEST:
+    return CMD_RESERVE_BEST;
+  case OP_SHOW:
+    return CMD_SHOW;
+  case OP_LIST:
+    return CMD_LIST_EVENTS;
+  case OP_STATS:
+    return CMD_STATS;
+  case OP_BARRIER:
+    return CMD_BARRIER;
+  case OP_WAIT:
+    return CMD_WAIT;
+  case OP_HELP:
+    return CMD_HELP;
+  default:
+    return CMD_INVALID;
+  }
+}
+
+static int binary_parse_stats(struct Reader *reader, unsigned int *event_id) {
+  uint64_t event;
+  if (read_varint(reader, &event) != 0 || event > (uint64_t)UINT_MAX + 1) {
+    return -1;
+  }
+
+  if (event == 0) {
+    return 0;
+  }
+
+  *event_id = (unsigned int)(event - 1);
+  return 1;
+}
+
+static enum Command binary_peek_command(struct Reader *reader, unsigned int *event_id,
+                                        int *has_event) {
+  enum Command command = binary_get_next(reader);
+
+  if (command == CMD_STATS) {
+    *has_event = binary_parse_stats(reader, event_id) == 1;
+    return command;
+  }
+
+  *has_event = (command == CMD_CREATE || command == CMD_RESERVE ||
+                command == CMD_RESERVE_BEST || command == CMD_SHOW) &&
+               read_varint_uint(reader, event_id) == 0;
+
+  return command;
+}
+
+static int binary_parse_create(struct Reader *reader, unsigned int *event_id,
+                               size_t *num_rows, size_t *num_cols) {
+  // Sizes are unsigned ints like in the text format, which cannot express larger events.
+  unsigned int u_num_rows, u_num_cols;
+  if (read_varint_uint(reader, event_id) != 0 || read_varint_uint(reader, &u_num_rows) != 0 ||
+      read_varint_uint(reader, &u_num_cols) != 0) {
+    return 1;
+  }
+
+  *num_rows = (size_t)u_num_rows;
+  *num_cols = (size_t)u_num_cols;
+  return 0;
+}
+
+static size_t binary_parse_reserve(struct Reader *reader, unsigned int *event_id,
+                                   struct Coords *coords) {
+  size_t num_coords;
+  if (read_varint_uint(reader, event_id) != 0 || read_varint_size(reader, &num_coords) != 0 ||
+      num_coords == 0) {
+    return 0;
+  }
+
+  // Every coordinate takes at least two bytes, so a larger count can only come
+  // from a corrupted file and must not be allocated for.
+  if (num_coords > (reader->len - reader->pos) / 2 || coords_reserve(coords, num_coords) != 0) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < num_coords; i++) {
+    unsigned int x, y;
+    if (read_varint_uint(reader, &x) != 0 || read_varint_uint(reader, &y) != 0) {
+      return 0;
+    }
+    coords->xs[i] = x;
+    coords->ys[i] = y;
+  }
+
+  return num_coords;
+}
+
+static int binary_parse_reserve_best(struct Reader *reader, unsigned int *event_id,
+                                     size_t *num_seats, size_t *row_hint) {
+  unsigned int u_num_seats, u_row_hint;
+  if (read_varint_uint(reader, event_id) != 0 || read_varint_uint(reader, &u_num_seats) != 0 ||
+      u_num_seats == 0 || read_varint_uint(reader, &u_row_hint) != 0) {
+    return 1;
+  }
+
+  *num_seats = (size_t)u_num_seats;
+  *row_hint = (size_t)u_row_hint;
+  return 0;
+}
+
+static int binary_parse_show(struct Reader *reader, unsigned int *event_id) {
+  return read_varint_uint(reader, event_id);
+}
+
+static int binary_parse_wait(struct Reader *reader, unsigned int *delay,
+                             unsigned int *thread_id) {
+  uint64_t thread;
+  if (read_varint_uint(reader, delay) != 0 || read_varint(reader, &thread) != 0 ||
+      thread > (uint64_t)UINT_MAX + 1) {
+    return -1;
+  }
+
+  if (thread == 0) {
+    return 0;
+  }
+
+  *thread_id = (unsigned int)(thread - 1);
+  return 1;
+}
+
+const struct JobsDecoder binary_decoder = {
+    .get_next = binary_get_next,
+    .peek_command = binary_peek_command,
+    .parse_create = binary_parse_create,
+    .parse_reserve = binary_parse_reserve,
+    .parse_reserve_best = binary_parse_reserve_best,
+    .parse_show = binary_parse_show,
+    .parse_stats = binary_parse_stats,
+    .parse_wait = binary_parse_wait,
+};
+
+const struct JobsDecoder *jobsbin_decoder(struct JobsMap *map) {
+  return map != NULL && map->binary ? &binary_decoder : &text_decoder;
+}
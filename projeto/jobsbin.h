@@ -0,0 +1,54 @@
+#ifndef EMS_JOBSBIN_H
+#define EMS_JOBSBIN_H
+
+#include <stddef.h>
+
+#include "parser.h"
+
+struct JobsMap;
+
+/// Extension of compiled .jobs files.
+#define JOBSBIN_EXTENSION ".jobsb"
+
+/// Compiled .jobs file layout, all integers little-endian:
+///   magic "EMSB", 1 byte version,
+///   8 bytes number of commands, 8 bytes number of BARRIERs,
+///   8 bytes index of each BARRIER among the commands,
+///   the commands.
+/// Each command is a 1 byte opcode followed by its arguments as LEB128
+/// varints. A RESERVE holds its id, the number of seats and then the row and
+/// column of each seat, a RESERVE_BEST its id, the number of seats and the
+/// hinted row, 0 for none. The thread of a WAIT and the event of a STATS are
+/// stored plus one, 0 meaning no thread or every event. Empty lines and
+/// comments are dropped and invalid commands are kept as OP_INVALID, so
+/// running the compiled file reports the same errors.
+#define JOBSBIN_MAGIC "EMSB"
+#define JOBSBIN_VERSION 1
+
+/// Compiles a text .jobs file.
+/// @param jobs_fd File descriptor of the .jobs file.
+/// @param out_fd File descriptor that receives the compiled file.
+/// @return 0 if the file was compiled successfully, 1 otherwise.
+int jobsbin_compile(int jobs_fd, int out_fd);
+
+/// Checks whether mapped data holds a compiled .jobs file.
+/// @param data Contents of the file.
+/// @param size Size of the file in bytes.
+/// @return 1 if the data starts with the compiled header, 0 otherwise.
+int jobsbin_is_compiled(const char *data, size_t size);
+
+/// Builds the command and BARRIER indexes of a mapped compiled file, in the
+/// lines and barriers of the map.
+/// @param map Map whose data holds a compiled file.
+/// @return 0 if the file is well formed, 1 otherwise.
+int jobsbin_index(struct JobsMap *map);
+
+/// Gets the decoder of the commands of a .jobs file.
+/// @param map Mapped .jobs file, NULL for a file read as text.
+/// @return The binary decoder for compiled files, the text one otherwise.
+const struct JobsDecoder *jobsbin_decoder(struct JobsMap *map);
+
+/// Decoder of compiled .jobs files.
+extern const struct JobsDecoder binary_decoder;
+
+#endif // EMS_JOBSBIN_H
@@ -0,0 +1,140 @@
+#include "jobsdir.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "constants.h"
+#include "jobsbin.h"
+#include "operations.h"
+
+/// A .jobs file found in the directory.
+struct JobsEntry {
+  char *name;
+  off_t size;
+};
+
+/// Checks whether a name ends with the .jobs extension, or the one of compiled files.
+/// @param name Name to be checked.
+/// @return 1 if it is a .jobs name, 0 otherwise.
+static int is_jobs_name(const char *name) {
+  size_t len = strlen(name);
+  return (len > 4 && !strcmp(name + len - 5, ".jobs")) || jobsdir_is_compiled(name);
+}
+
+/// Checks whether a text .jobs file has been compiled next to itself.
+/// @param dir_fd Directory of the file.
+/// @param name Name of the text .jobs file.
+/// @return 1 if a regular file with the compiled name exists, 0 otherwise.
+static int has_compiled_twin(int dir_fd, const char *name) {
+  size_t stem_len = strlen(name) - strlen(".jobs");
+  char *twin = (char *)safe_malloc(stem_len + sizeof(JOBSBIN_EXTENSION));
+  memcpy(twin, name, stem_len);
+  strcpy(twin + stem_len, JOBSBIN_EXTENSION);
+
+  struct stat st;
+  int found = fstatat(dir_fd, twin, &st, 0) == 0 && S_ISREG(st.st_mode);
+  free(twin);
+  return found;
+}
+
+/// Compares two entries, so that larger files come first and files of the same
+/// size keep a fixed order.
+/// @param a First entry.
+/// @param b Second entry.
+/// @return an integer representing the relative order between the entries.
+static int compareJobsEntries(const void *a, const void *b) {
+  const struct JobsEntry *entry_a = (const struct JobsEntry *)a;
+  const struct JobsEntry *entry_b = (const struct JobsEntry *)b;
+
+  if (entry_a->size != entry_b->size) {
+    return entry_a->size > entry_b->size ? -1 : 1;
+  }
+  return strcmp(entry_a->name, entry_b->name);
+}
+
+int jobsdir_is_compiled(const char *name) {
+  size_t len = strlen(name);
+  size_t ext_len = strlen(JOBSBIN_EXTENSION);
+  return len > ext_len && !strcmp(name + len - ext_len, JOBSBIN_EXTENSION);
+}
+
+char **jobsdir_scan(const char *dir_path, size_t *num_files) {
+  DIR *dir = opendir(dir_path);
+
+  if (dir == NULL) {
+    fprintf(stderr, "Failed to open directory\n");
+    return NULL;
+  }
+
+  size_t count = 0;
+  size_t capacity = 16;
+  struct JobsEntry *entries = (struct JobsEntry *)safe_malloc(capacity * sizeof(struct JobsEntry));
+
+  struct dirent *dp;
+  while ((dp = readdir(dir)) != NULL) {
+    if (!is_jobs_name(dp->d_name)) {
+      continue;
+    }
+
+    // d_type may be DT_UNKNOWN, and the size is needed anyway.
+    struct stat st;
+    if (fstatat(dirfd(dir), dp->d_name, &st, 0) == -1) {
+      fprintf(stderr, "Failed to stat .jobs file\n");
+      continue;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+      continue;
+    }
+
+    // Both files would write the same .out and .stats files, the compiled one wins.
+    if (!jobsdir_is_compiled(dp->d_name) && has_compiled_twin(dirfd(dir), dp->d_name)) {
+      continue;
+    }
+
+    if (count == capacity) {
+      capacity *= 2;
+      struct JobsEntry *grown =
+          (struct JobsEntry *)realloc(entries, capacity * sizeof(struct JobsEntry));
+      if (grown == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(1);
+      }
+      entries = grown;
+    }
+
+    entries[count].name = (char *)safe_malloc(strlen(dp->d_name) + 1);
+    strcpy(entries[count].name, dp->d_name);
+    entries[count].size = st.st_size;
+    count++;
+  }
+
+  if (closedir(dir) == -1) {
+    fprintf(stderr, "Failed to close directory\n");
+  }
+
+  if (JOBS_LARGEST_FIRST) {
+    qsort(entries, count, sizeof(struct JobsEntry), compareJobsEntries);
+  }
+
+  char **names = (char **)safe_malloc((count > 0 ? count : 1) * sizeof(char *));
+  for (size_t i = 0; i < count; i++) {
+    names[i] = entries[i].name;
+  }
+  free(entries);
+
+  *num_files = count;
+  return names;
+}
+
+void jobsdir_free(char **names, size_t num_files) {
+  for (size_t i = 0; i < num_files; i++) {
+    free(names[i]);
+  }
+  free(names);
+}
@@ -0,0 +1,28 @@
+#ifndef EMS_JOBSDIR_H
+#define EMS_JOBSDIR_H
+
+#include <stddef.h>
+
+/// Lists the .jobs files of a directory, compiled or not, largest first.
+/// @note Every entry is checked with stat, so the result does not depend on
+/// the file system filling in d_type. Running the largest files first keeps a
+/// large file found late from finishing long after everything else. A .jobs
+/// file is left out when its compiled .jobsb twin is in the directory, since
+/// both would write the same .out and .stats files: the compiled one is run.
+/// @param dir_path Directory to be scanned.
+/// @param num_files Receives the number of files found.
+/// @return Array of num_files names, to be released with jobsdir_free, or NULL if
+/// the directory could not be read.
+char **jobsdir_scan(const char *dir_path, size_t *num_files);
+
+/// Checks whether a name is the one of a compiled .jobs file.
+/// @param name Name to be checked.
+/// @return 1 if the name has the compiled extension, 0 otherwise.
+int jobsdir_is_compiled(const char *name);
+
+/// Frees the names returned by jobsdir_scan.
+/// @param names Names to be freed.
+/// @param num_files Number of names.
+void jobsdir_free(char **names, size_t num_files);
+
+#endif // EMS_JOBSDIR_H
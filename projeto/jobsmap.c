@@ -0,0 +1,155 @@
+#include "jobsmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "jobsbin.h"
+
+/// Checks whether a line holds a BARRIER command.
+/// @param map Map containing the line.
+/// @param line Index of the line.
+/// @return 1 if the line is a BARRIER, 0 otherwise.
+static int is_barrier(struct JobsMap *map, size_t line) {
+  size_t start = map->lines[line];
+  size_t stop = line + 1 < map->num_lines ? map->lines[line + 1] : map->size;
+  size_t len = stop - start;
+
+  if (len > 0 && map->data[stop - 1] == '\n') {
+    len--;
+  }
+
+  return len == strlen("BARRIER") && strncmp(map->data + start, "BARRIER", len) == 0;
+}
+
+/// Finds the line that ends the segment starting at the given line.
+/// @param map Map to be searched.
+/// @param line First line of the segment.
+/// @return Index of the next BARRIER line, num_lines if there is none.
+static size_t segment_end(struct JobsMap *map, size_t line) {
+  // Compiled files list their BARRIERs, so the next one is found by binary search.
+  if (map->binary) {
+    size_t low = 0;
+    size_t high = map->num_barriers;
+    while (low < high) {
+      size_t mid = low + (high - low) / 2;
+      if (map->barriers[mid] < line) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low < map->num_barriers ? map->barriers[low] : map->num_lines;
+  }
+
+  while (line < map->num_lines && !is_barrier(map, line)) {
+    line++;
+  }
+
+  return line;
+}
+
+int jobsmap_init(struct JobsMap *map, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+    return 1;
+  }
+
+  map->data = NULL;
+  map->size = (size_t)st.st_size;
+  map->lines = NULL;
+  map->num_lines = 0;
+  map->binary = 0;
+  map->barriers = NULL;
+  map->num_barriers = 0;
+
+  if (map->size > 0) {
+    map->data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map->data == MAP_FAILED) {
+      fprintf(stderr, "Failed to map .jobs file\n");
+      return 1;
+    }
+    posix_madvise(map->data, map->size, POSIX_MADV_SEQUENTIAL);
+  }
+
+  if (jobsbin_is_compiled(map->data, map->size)) {
+    map->binary = 1;
+    if (jobsbin_index(map) != 0) {
+      fprintf(stderr, "Invalid compiled .jobs file\n");
+      jobsmap_destroy(map);
+      return 1;
+    }
+  }
+
+  size_t capacity = 0;
+  size_t offset = 0;
+  while (!map->binary && offset < map->size) {
+    if (map->num_lines == capacity) {
+      capacity = capacity == 0 ? 1024 : capacity * 2;
+      size_t *lines = realloc(map->lines, capacity * sizeof(size_t));
+      if (lines == NULL) {
+        fprintf(stderr, "Error allocating memory for line index\n");
+        jobsmap_destroy(map);
+        return 1;
+      }
+      map->lines = lines;
+    }
+    map->lines[map->num_lines++] = offset;
+
+    char *newline = memchr(map->data + offset, '\n', map->size - offset);
+    offset = newline == NULL ? map->size : (size_t)(newline - map->data) + 1;
+  }
+
+  map->begin = 0;
+  map->end = segment_end(map, 0);
+  atomic_init(&map->next, 0);
+
+  return 0;
+}
+
+void jobsmap_destroy(struct JobsMap *map) {
+  if (map->data != NULL) {
+    munmap(map->data, map->size);
+    map->data = NULL;
+  }
+
+  free(map->lines);
+  map->lines = NULL;
+  map->num_lines = 0;
+
+  free(map->barriers);
+  map->barriers = NULL;
+  map->num_barriers = 0;
+}
+
+int jobsmap_claim(struct JobsMap *map, struct Reader *line) {
+  // Once the segment is exhausted the counter keeps growing, which is harmless.
+  size_t index = atomic_fetch_add(&map->next, 1);
+  if (index >= map->end) {
+    return 1;
+  }
+
+  jobsmap_line(map, index, line);
+  return 0;
+}
+
+void jobsmap_line(struct JobsMap *map, size_t index, struct Reader *line) {
+  size_t start = map->lines[index];
+  size_t stop = index + 1 < map->num_lines ? map->lines[index + 1] : map->size;
+  reader_init_mem(line, map->data + start, stop - start);
+}
+
+int jobsmap_at_barrier(struct JobsMap *map) {
+  return map->end < map->num_lines;
+}
+
+void jobsmap_next_segment(struct JobsMap *map) {
+  if (map->end < map->num_lines) {
+    map->begin = map->end + 1;
+    map->end = segment_end(map, map->begin);
+  }
+
+  atomic_store(&map->next, map->begin);
+}
@@ -0,0 +1,60 @@
+#ifndef EMS_JOBSMAP_H
+#define EMS_JOBSMAP_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "reader.h"
+
+/// A .jobs file mapped into memory and split into lines, so that commands can
+/// be claimed and parsed concurrently without a shared lock.
+struct JobsMap {
+  char *data;  /// Contents of the .jobs file, NULL if the file is empty.
+  size_t size; /// Size of the file in bytes.
+
+  size_t *lines;    /// Offsets of the start of each line, or of each command if compiled.
+  size_t num_lines; /// Number of lines in the file.
+
+  int binary;          /// 1 if the file is compiled (see jobsbin.h), 0 if it is text.
+  size_t *barriers;    /// Lines of the BARRIERs of a compiled file, in order.
+  size_t num_barriers; /// Number of BARRIERs of a compiled file.
+
+  size_t begin;       /// First line of the current segment.
+  size_t end;         /// Line that ends the current segment (a BARRIER or num_lines).
+  atomic_size_t next; /// Next line of the current segment to be claimed.
+};
+
+/// Maps a .jobs file and builds its line index. Compiled files are detected by
+/// their header and indexed by command.
+/// @param map Map to be initialized.
+/// @param fd File descriptor of the .jobs file.
+/// @return 0 if the file was mapped successfully, 1 otherwise.
+int jobsmap_init(struct JobsMap *map, int fd);
+
+/// Unmaps the file and frees the line index.
+/// @param map Map to be destroyed.
+void jobsmap_destroy(struct JobsMap *map);
+
+/// Claims the next line of the current segment.
+/// @param map Map to claim the line from.
+/// @param line Reader to be initialized over the claimed line.
+/// @return 0 if a line was claimed, 1 if the segment has no more lines.
+int jobsmap_claim(struct JobsMap *map, struct Reader *line);
+
+/// Reads a given line, without claiming it.
+/// @param map Map containing the line.
+/// @param index Index of the line, below num_lines.
+/// @param line Reader to be initialized over the line.
+void jobsmap_line(struct JobsMap *map, size_t index, struct Reader *line);
+
+/// Checks whether the current segment ends with a BARRIER.
+/// @param map Map to be checked.
+/// @return 1 if the segment ends with a BARRIER, 0 if it ends the file.
+int jobsmap_at_barrier(struct JobsMap *map);
+
+/// Moves to the segment after the current BARRIER.
+/// @note Must not be called while other threads are claiming lines.
+/// @param map Map to be modified.
+void jobsmap_next_segment(struct JobsMap *map);
+
+#endif // EMS_JOBSMAP_H
@@ -2,7 +2,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
@@ -10,15 +9,56 @@
 #include <pthread.h>
 
 #include "constants.h"
+#include "jobsbin.h"
+#include "jobsdir.h"
+#include "jobsmap.h"
+#include "metrics.h"
 #include "operations.h"
 #include "parser.h"
+#include "partition.h"
+#include "reader.h"
+#include "scheduler.h"
+#include "shard.h"
 
 
 int main(int argc, char *argv[]) {
   unsigned int state_access_delay_ms = STATE_ACCESS_DELAY_MS;
 
+  if (argc > 1 && !strcmp(argv[1], "compile")) {
+    if (argc != 4) {
+      fprintf(stderr, "Usage: %s compile <jobs_file> <jobsb_file>\n", argv[0]);
+      return 1;
+    }
+
+    int jobs_fd = open(argv[2], O_RDONLY);
+    if (jobs_fd == -1) {
+      fprintf(stderr, "Failed to open .jobs file\n");
+      return 1;
+    }
+
+    int out_fd = open(argv[3], O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (out_fd == -1) {
+      fprintf(stderr, "Failed to open %s file\n", JOBSBIN_EXTENSION);
+      close(jobs_fd);
+      return 1;
+    }
+
+    int failed = jobsbin_compile(jobs_fd, out_fd);
+    if (failed) {
+      fprintf(stderr, "Failed to compile .jobs file\n");
+    }
+
+    close(jobs_fd);
+    if (close(out_fd) == -1) {
+      fprintf(stderr, "Failed to close %s file\n", JOBSBIN_EXTENSION);
+      return 1;
+    }
+    return failed;
+  }
+
   if (argc < 4) {
     fprintf(stderr, "Usage: %s <dir_path> <MAX_PROC> <MAX_THREADS> [delay]\n", argv[0]);
+    fprintf(stderr, "       %s compile <jobs_file> <jobsb_file>\n", argv[0]);
     return 1;
   }
 
@@ -34,174 +74,234 @@ int main(int argc, char *argv[]) {
     state_access_delay_ms = (unsigned int)delay;
   }
 
-  if (ems_init(state_access_delay_ms)) {
+  // Sharded files only use each event from the thread that owns it, so its seats need no locks.
+  int sharded = JOBS_SHARDED && !JOBS_PARTITIONED && !JOBS_SCHEDULER && !EMS_SHARED_STATE;
+
+  if (ems_init(state_access_delay_ms, sharded ? LOCK_NONE : SEAT_LOCK_MODE, EMS_SHARED_STATE)) {
     fprintf(stderr, "Failed to initialize EMS\n");
     return 1;
   }
 
   char *dir_path = argv[1];
-  DIR *dir = opendir(dir_path);
-
-  if (dir == NULL) {
-    fprintf(stderr, "Failed to open directory\n");
-    return 1;
-  }
-
-  struct dirent *dp;
-  errno = 0;
 
   int MAX_PROC = atoi(argv[2]);
   int num_active_proc = 0;
 
   int MAX_THREADS = atoi(argv[3]);
 
-  while((dp = readdir(dir)) != NULL) {
+  // The files are listed and ordered up front, before any fork.
+  size_t num_files = 0;
+  char **names = jobsdir_scan(dir_path, &num_files);
 
-    if (dp->d_type == DT_REG && strlen(dp->d_name) > 4 && !strcmp(dp->d_name + strlen(dp->d_name) - 5, ".jobs")) {
-      int status;
+  if (names == NULL) {
+    return 1;
+  }
 
-      if (num_active_proc == MAX_PROC) {
-        wait(&status);
-        num_active_proc--;
+  if (JOBS_SCHEDULER) {
+    // One pool of MAX_PROC * MAX_THREADS workers runs every file, no process is forked.
+    int failed = schedule_jobs(dir_path, names, num_files, MAX_PROC * MAX_THREADS, MAX_THREADS);
 
-        if (WIFEXITED(status)) {
-          printf("Child process exited with status %d\n", WEXITSTATUS(status));
-        } else if (WIFSIGNALED(status)) {
-          printf("Child process exited due to signal %d\n", WTERMSIG(status));
-        }
-      }
+    jobsdir_free(names, num_files);
+
+    return ems_terminate() || failed;
+  }
 
-      int pid = fork();
+  for (size_t f = 0; f < num_files; f++) {
+    int status;
 
-      if (pid == -1) {
-        fprintf(stderr, "Failed to fork\n");
-        return 1;
+    if (num_active_proc == MAX_PROC) {
+      wait(&status);
+      num_active_proc--;
+
+      if (WIFEXITED(status)) {
+        printf("Child process exited with status %d\n", WEXITSTATUS(status));
+      } else if (WIFSIGNALED(status)) {
+        printf("Child process exited due to signal %d\n", WTERMSIG(status));
       }
+    }
 
-      num_active_proc++;
+    int pid = fork();
 
-      if (pid == 0) {
-        size_t len_path = strlen(argv[1]) + 1 + strlen(dp->d_name) + 1; // +1 for '/' and +1 for '\0'
+    if (pid == -1) {
+      fprintf(stderr, "Failed to fork\n");
+      return 1;
+    }
 
-        char *jobs_file_path = (char*) safe_malloc(len_path);
-        strcpy(jobs_file_path, argv[1]);
-        strcat(jobs_file_path, "/");
-        strcat(jobs_file_path, dp->d_name);
+    num_active_proc++;
 
-        int jobs_fd = open(jobs_file_path, O_RDONLY);
+    if (pid == 0) {
+      size_t len_path = strlen(argv[1]) + 1 + strlen(names[f]) + 1; // +1 for '/' and +1 for '\0'
 
-        if (jobs_fd == -1) {
-          fprintf(stderr, "Failed to open .jobs file\n");
-          return 1;
-        }
+      char *jobs_file_path = (char*) safe_malloc(len_path);
+      strcpy(jobs_file_path, argv[1]);
+      strcat(jobs_file_path, "/");
+      strcat(jobs_file_path, names[f]);
 
-        int openFlags = O_WRONLY | O_CREAT | O_TRUNC;
-        mode_t filePerms = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+      int jobs_fd = open(jobs_file_path, O_RDONLY);
 
-        char *out_file_path = (char*) safe_malloc(len_path);
-        memset(out_file_path, 0, len_path);
-        strncpy(out_file_path, jobs_file_path, strlen(jobs_file_path) - 5);
-        strcat(out_file_path, ".out");
+      if (jobs_fd == -1) {
+        fprintf(stderr, "Failed to open .jobs file\n");
+        return 1;
+      }
 
-        int out_fd = open(out_file_path, openFlags, filePerms);
+      struct Reader jobs;
+      if (reader_init(&jobs, jobs_fd) != 0) {
+        return 1;
+      }
 
-        if (out_fd == -1) {
-          fprintf(stderr, "Failed to open .out file\n");
-          return 1;
-        }
+      // Falls back to reading the file under a lock if it cannot be mapped. Compiled
+      // files and the sharded mode can only be run mapped.
+      int must_map = jobsdir_is_compiled(names[f]) || sharded;
+      struct JobsMap map;
+      struct JobsMap *jobs_map = NULL;
+      if ((JOBS_MMAP || must_map) && jobsmap_init(&map, jobs_fd) == 0) {
+        jobs_map = &map;
+      } else if (must_map) {
+        fprintf(stderr, "Failed to map .jobs file\n");
+        reader_destroy(&jobs);
+        close(jobs_fd);
+        free(jobs_file_path);
+        jobsdir_free(names, num_files);
+        return 1;
+      }
 
-        int threads_id[MAX_THREADS];
-        for (int i=0; i<MAX_THREADS; i++) {
-          threads_id[i] = i;
-        }
+      int openFlags = O_WRONLY | O_CREAT | O_TRUNC;
+      mode_t filePerms = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
 
-        pthread_t threads[MAX_THREADS];
+      char *out_file_path = (char*) safe_malloc(len_path);
+      memset(out_file_path, 0, len_path);
+      strncpy(out_file_path, jobs_file_path, (size_t)(strrchr(jobs_file_path, '.') - jobs_file_path));
+      strcat(out_file_path, ".out");
 
-        unsigned int *delays = (unsigned int*) safe_malloc((size_t)MAX_THREADS * sizeof(unsigned int));
-        for (int i=0; i<MAX_THREADS; i++) {
-          delays[i]=0;
-        }
+      int out_fd = open(out_file_path, openFlags, filePerms);
 
-        pthread_mutex_t rd_jobs_mutex;
-        safe_mutex_init(&rd_jobs_mutex);
-        pthread_mutex_t wr_out_mutex;
-        safe_mutex_init(&wr_out_mutex);
-        pthread_mutex_t reservation;
-        safe_mutex_init(&reservation);
-        pthread_rwlock_t rwlock_events;
-        safe_rwlock_init(&rwlock_events);
-
-        void *ret_value;
-        int exitFlag;
-
-        while (1) {
-          exitFlag = 1;
-
-          for (int i = 0; i < MAX_THREADS; i++) {
-            struct thread_args *args = (struct thread_args*) safe_malloc(sizeof(struct thread_args));
-            args->id = threads_id[i];
-            args->jobs_fd = jobs_fd;
-            args->out_fd = out_fd;
-            args->MAX_THREADS = MAX_THREADS;
-            args->delays = delays;
-            args->rd_jobs_mutex = &rd_jobs_mutex;
-            args->reservation = &reservation;
-            args->wr_out_mutex= &wr_out_mutex;
-            args->rwlock_events = &rwlock_events;
-
-            if (pthread_create(&threads[i], NULL, thread_func, args) != 0) {
-              fprintf(stderr, "Failed to create thread\n");
-              return 1;
-            }
-          }
-
-          for (int i = 0; i < MAX_THREADS; i++) {
-            if (pthread_join(threads[i], &ret_value) != 0) {
-              fprintf(stderr, "Failed to join thread\n");
-              free(ret_value);
-              return 1;
-            } else if (*(int*) ret_value == 1) {
-                exitFlag = 0;
-            }
-            free(ret_value);
-          }
-
-          if (exitFlag == 1) {
-            break;
-          } else {
-            cleanup(jobs_fd);
-          }
-        }
+      if (out_fd == -1) {
+        fprintf(stderr, "Failed to open .out file\n");
+        return 1;
+      }
+
+      int threads_id[MAX_THREADS];
+      for (int i=0; i<MAX_THREADS; i++) {
+        threads_id[i] = i;
+      }
 
-        free(delays);
+      pthread_t threads[MAX_THREADS];
 
-        safe_mutex_destroy(&rd_jobs_mutex);
-        safe_mutex_destroy(&reservation);
-        safe_mutex_destroy(&wr_out_mutex);
-        safe_rwlock_destroy(&rwlock_events);
+      atomic_uint *delays = (atomic_uint*) safe_malloc((size_t)MAX_THREADS * sizeof(atomic_uint));
+      for (int i=0; i<MAX_THREADS; i++) {
+        atomic_init(&delays[i], 0);
+      }
+
+      pthread_mutex_t rd_jobs_mutex;
+      safe_mutex_init(&rd_jobs_mutex);
+      pthread_mutex_t wr_out_mutex;
+      safe_mutex_init(&wr_out_mutex);
+
+      // The same threads run the whole .jobs file and meet at this barrier on each BARRIER.
+      pthread_barrier_t segment_barrier;
+      safe_barrier_init(&segment_barrier, (unsigned int)MAX_THREADS);
+
+      // Splits each segment between the threads by event, for a reproducible .out file.
+      struct Partition partition;
+      struct Partition *jobs_partition = NULL;
+      if (JOBS_PARTITIONED && jobs_map != NULL) {
+        partition_init(&partition, jobs_map, MAX_THREADS);
+        jobs_partition = &partition;
+      }
+
+      // Routes the commands to the threads by event, from this thread.
+      struct Shards shards;
+      struct Shards *jobs_shards = NULL;
+      if (sharded) {
+        shards_init(&shards, jobs_map, MAX_THREADS);
+        jobs_shards = &shards;
+      }
+
+      struct Metrics *metrics = NULL;
+      if (EMS_METRICS && (metrics = metrics_create(jobs_file_path)) == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return 1;
+      }
+
+      void *(*start_routine)(void *) = thread_func;
+      if (jobs_partition != NULL) {
+        start_routine = partition_thread_func;
+      } else if (jobs_shards != NULL) {
+        start_routine = shard_thread_func;
+      }
 
-        if (close(jobs_fd) == -1) {
-          fprintf(stderr, "Failed to close .jobs file\n");
+      struct thread_args args[MAX_THREADS];
+
+      for (int i = 0; i < MAX_THREADS; i++) {
+        args[i].id = threads_id[i];
+        args[i].jobs = &jobs;
+        args[i].jobs_map = jobs_map;
+        args[i].out_fd = out_fd;
+        args[i].MAX_THREADS = MAX_THREADS;
+        args[i].delays = delays;
+        args[i].rd_jobs_mutex = &rd_jobs_mutex;
+        args[i].wr_out_mutex= &wr_out_mutex;
+        args[i].segment_barrier = &segment_barrier;
+        args[i].partition = jobs_partition;
+        args[i].shards = jobs_shards;
+        args[i].metrics = metrics;
+
+        if (pthread_create(&threads[i], NULL, start_routine, &args[i]) != 0) {
+          fprintf(stderr, "Failed to create thread\n");
           return 1;
         }
+      }
+
+      if (jobs_shards != NULL) {
+        shards_dispatch(jobs_shards, &args[0]);
+      }
 
-        if (close(out_fd) == -1) {
-          fprintf(stderr, "Failed to close .out file\n");
+      for (int i = 0; i < MAX_THREADS; i++) {
+        if (pthread_join(threads[i], NULL) != 0) {
+          fprintf(stderr, "Failed to join thread\n");
           return 1;
         }
+      }
 
-        free(jobs_file_path);
-        free(out_file_path);
+      if (metrics != NULL) {
+        metrics_write(metrics);
+        metrics_destroy(metrics);
+      }
 
-        exit(0);
+      free(delays);
+      reader_destroy(&jobs);
+      if (jobs_shards != NULL) {
+        shards_destroy(jobs_shards);
+      }
+      if (jobs_partition != NULL) {
+        partition_destroy(jobs_partition);
+      }
+      if (jobs_map != NULL) {
+        jobsmap_destroy(jobs_map);
       }
+
+      safe_mutex_destroy(&rd_jobs_mutex);
+      safe_mutex_destroy(&wr_out_mutex);
+      safe_barrier_destroy(&segment_barrier);
+
+      if (close(jobs_fd) == -1) {
+        fprintf(stderr, "Failed to close .jobs file\n");
+        return 1;
+      }
+
+      if (close(out_fd) == -1) {
+        fprintf(stderr, "Failed to close .out file\n");
+        return 1;
+      }
+
+      free(jobs_file_path);
+      free(out_file_path);
+
+      exit(0);
     }
   }
 
-  if (closedir(dir) == -1) {
-    fprintf(stderr, "Failed to close directory\n");
-    return 1;
-  }
+  jobsdir_free(names, num_files);
 
   while (num_active_proc > 0) {
     int status;
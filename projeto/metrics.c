@@ -0,0 +1,322 @@
+#include "metrics.h"
+
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "operations.h"
+
+/// Bits of a value kept below its leading bit, so that a recorded latency is
+/// off by at most 1 / 2^HIST_SUB_BITS of its value.
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+/// Log-linear histogram of latencies: exact below HIST_SUB_BUCKETS, then
+/// HIST_SUB_BUCKETS buckets per power of two.
+struct Histogram {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[HIST_BUCKETS];
+};
+
+/// Metrics recorded by one thread. Each slot is a separate allocation aligned to
+/// a cache line, so threads never write to the same line.
+struct MetricsSlot {
+  alignas(64) uint64_t counters[METRIC_NUM_COUNTERS];
+  uint64_t started[METRIC_NUM_TIMERS]; /// Start of the running latency of each timer.
+  struct Histogram histograms[METRIC_NUM_TIMERS];
+  pthread_t owner;
+  struct MetricsSlot *next;
+};
+
+struct Metrics {
+  pthread_mutex_t lock;      /// Protects the list of slots.
+  struct MetricsSlot *slots; /// Slot of every thread that recorded into the metrics.
+  char *path;                /// Path of the .stats file.
+};
+
+static const char *const timer_names[METRIC_NUM_TIMERS] = {
+    "create",
+    "reserve",
+    "reserve_best",
+    "show",
+    "list",
+    "stats",
+    "wait",
+    "other",
+    "parse",
+    "jobs_lock_wait",
+    "seat_wrlock_wait",
+    "seat_rdlock_wait",
+    "seat_lock_hold",
+    "out_lock_wait",
+    "out_lock_hold",
+    "state_delay",
+};
+
+static const char *const counter_names[METRIC_NUM_COUNTERS] = {
+    "seats_reserved",
+    "reserve_conflicts",
+    "reserve_best_retries",
+    "output_bytes",
+};
+
+static _Thread_local struct Metrics *current_metrics = NULL;
+static _Thread_local struct MetricsSlot *current_slot = NULL;
+
+/// Gets the current time.
+/// @return Nanoseconds of the monotonic clock.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/// Gets the bucket of a value.
+static size_t bucket_of(uint64_t value) {
+  if (value < HIST_SUB_BUCKETS) {
+    return (size_t)value;
+  }
+
+  unsigned int top = 63 - (unsigned int)__builtin_clzll(value);
+  unsigned int shift = top - HIST_SUB_BITS;
+  return (size_t)(shift + 1) * HIST_SUB_BUCKETS +
+         (size_t)((value >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+/// Gets the largest value of a bucket.
+static uint64_t bucket_max(size_t bucket) {
+  if (bucket < HIST_SUB_BUCKETS) {
+    return bucket;
+  }
+
+  unsigned int shift = (unsigned int)(bucket / HIST_SUB_BUCKETS) - 1;
+  uint64_t first = (uint64_t)(HIST_SUB_BUCKETS + bucket % HIST_SUB_BUCKETS) << shift;
+  return first + (((uint64_t)1 << shift) - 1);
+}
+
+/// Gets the value below which a fraction of the recorded values fall.
+/// @param histogram Histogram with at least one value.
+/// @param fraction Fraction of the values, from 0 to 1.
+/// @return Largest value of the bucket of the percentile, at most the maximum.
+static uint64_t percentile(const struct Histogram *histogram, double fraction) {
+  uint64_t rank = (uint64_t)(fraction * (double)histogram->count + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < HIST_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint64_t value = bucket_max(i);
+      return value < histogram->max ? value : histogram->max;
+    }
+  }
+
+  return histogram->max;
+}
+
+struct Metrics *metrics_create(const char *jobs_path) {
+  struct Metrics *metrics = (struct Metrics *)malloc(sizeof(struct Metrics));
+  if (metrics == NULL) {
+    return NULL;
+  }
+
+  const char *dot = strrchr(jobs_path, '.');
+  size_t stem_len = dot != NULL ? (size_t)(dot - jobs_path) : strlen(jobs_path);
+  metrics->path = (char *)malloc(stem_len + sizeof(".stats"));
+  if (metrics->path == NULL) {
+    free(metrics);
+    return NULL;
+  }
+  memcpy(metrics->path, jobs_path, stem_len);
+  strcpy(metrics->path + stem_len, ".stats");
+
+  safe_mutex_init(&metrics->lock);
+  metrics->slots = NULL;
+
+  return metrics;
+}
+
+int metrics_write(struct Metrics *metrics) {
+  FILE *file = fopen(metrics->path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open .stats file\n");
+    return 1;
+  }
+
+  // The slots are only added up here, so recording never touches shared data.
+  uint64_t counters[METRIC_NUM_COUNTERS] = {0};
+  for (struct MetricsSlot *slot = metrics->slots; slot != NULL; slot = slot->next) {
+    for (int i = 0; i < METRIC_NUM_COUNTERS; i++) {
+      counters[i] += slot->counters[i];
+    }
+  }
+
+  for (int i = 0; i < METRIC_NUM_COUNTERS; i++) {
+    fprintf(file, "counter %s %" PRIu64 "\n", counter_names[i], counters[i]);
+  }
+
+  fprintf(file, "timer count mean_ns p50_ns p90_ns p99_ns p999_ns max_ns\n");
+
+  struct Histogram *total = (struct Histogram *)malloc(sizeof(struct Histogram));
+  if (total == NULL) {
+    fclose(file);
+    return 1;
+  }
+
+  for (int t = 0; t < METRIC_NUM_TIMERS; t++) {
+    memset(total, 0, sizeof(struct Histogram));
+    for (struct MetricsSlot *slot = metrics->slots; slot != NULL; slot = slot->next) {
+      const struct Histogram *histogram = &slot->histograms[t];
+      total->count += histogram->count;
+      total->sum += histogram->sum;
+      total->max = histogram->max > total->max ? histogram->max : total->max;
+      for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        total->buckets[i] += histogram->buckets[i];
+      }
+    }
+
+    if (total->count == 0) {
+      fprintf(file, "%s 0 0 0 0 0 0 0\n", timer_names[t]);
+      continue;
+    }
+
+    fprintf(file, "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                  " %" PRIu64 "\n",
+            timer_names[t], total->count, total->sum / total->count, percentile(total, 0.5),
+            percentile(total, 0.9), percentile(total, 0.99), percentile(total, 0.999),
+            total->max);
+  }
+
+  // The buckets themselves let the histograms of several files be merged.
+  for (int t = 0; t < METRIC_NUM_TIMERS; t++) {
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+      uint64_t count = 0;
+      for (struct MetricsSlot *slot = metrics->slots; slot != NULL; slot = slot->next) {
+        count += slot->histograms[t].buckets[i];
+      }
+      if (count > 0) {
+        fprintf(file, "bucket %s %" PRIu64 " %" PRIu64 "\n", timer_names[t], bucket_max(i),
+                count);
+      }
+    }
+  }
+
+  free(total);
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Failed to close .stats file\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+void metrics_destroy(struct Metrics *metrics) {
+  struct MetricsSlot *slot = metrics->slots;
+  while (slot != NULL) {
+    struct MetricsSlot *next = slot->next;
+    free(slot);
+    slot = next;
+  }
+
+  safe_mutex_destroy(&metrics->lock);
+  free(metrics->path);
+  free(metrics);
+}
+
+void metrics_attach(struct Metrics *metrics) {
+  if (metrics == current_metrics) {
+    return;
+  }
+
+  current_metrics = metrics;
+  current_slot = NULL;
+  if (metrics == NULL) {
+    return;
+  }
+
+  // A worker of the scheduler moves between files, so it keeps the slot it
+  // already has in each of them.
+  pthread_t self = pthread_self();
+  safe_mutex_lock(&metrics->lock);
+  struct MetricsSlot *slot = metrics->slots;
+  while (slot != NULL && !pthread_equal(slot->owner, self)) {
+    slot = slot->next;
+  }
+
+  if (slot == NULL) {
+    slot = (struct MetricsSlot *)aligned_alloc(alignof(struct MetricsSlot),
+                                               sizeof(struct MetricsSlot));
+    if (slot != NULL) {
+      memset(slot, 0, sizeof(struct MetricsSlot));
+      slot->owner = self;
+      slot->next = metrics->slots;
+      metrics->slots = slot;
+    }
+  }
+  safe_mutex_unlock(&metrics->lock);
+
+  current_slot = slot;
+}
+
+void metrics_begin(enum MetricTimer timer) {
+  if (current_slot != NULL) {
+    current_slot->started[timer] = now_ns();
+  }
+}
+
+void metrics_end(enum MetricTimer timer) {
+  struct MetricsSlot *slot = current_slot;
+  if (slot == NULL) {
+    return;
+  }
+
+  uint64_t value = now_ns() - slot->started[timer];
+  struct Histogram *histogram = &slot->histograms[timer];
+  histogram->count++;
+  histogram->sum += value;
+  histogram->max = value > histogram->max ? value : histogram->max;
+  histogram->buckets[bucket_of(value)]++;
+}
+
+void metrics_add(enum MetricCounter counter, uint64_t value) {
+  if (current_slot != NULL) {
+    current_slot->counters[counter] += value;
+  }
+}
+
+enum MetricTimer metrics_command_timer(enum Command command) {
+  switch (command) {
+  case CMD_CREATE:
+    return METRIC_CREATE;
+  case CMD_RESERVE:
+    return METRIC_RESERVE;
+  case CMD_RESERVE_BEST:
+    return METRIC_RESERVE_BEST;
+  case CMD_SHOW:
+    return METRIC_SHOW;
+  case CMD_LIST_EVENTS:
+    return METRIC_LIST;
+  case CMD_STATS:
+    return METRIC_STATS;
+  case CMD_WAIT:
+    return METRIC_WAIT;
+  case CMD_BARRIER:
+  case CMD_HELP:
+  case CMD_EMPTY:
+  case CMD_INVALID:
+  case EOC:
+    return METRIC_OTHER;
+  }
+
+  return METRIC_OTHER;
+}
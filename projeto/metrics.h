@@ -0,0 +1,99 @@
+#ifndef EMS_METRICS_H
+#define EMS_METRICS_H
+
+#include <stdint.h>
+
+#include "constants.h"
+#include "parser.h"
+
+/// Latencies that are timed, in nanoseconds.
+enum MetricTimer {
+  METRIC_CREATE,         /// CREATE commands.
+  METRIC_RESERVE,        /// RESERVE commands.
+  METRIC_RESERVE_BEST,   /// RESERVE_BEST commands.
+  METRIC_SHOW,           /// SHOW commands.
+  METRIC_LIST,           /// LIST commands.
+  METRIC_STATS,          /// STATS commands.
+  METRIC_WAIT,           /// WAIT commands.
+  METRIC_OTHER,          /// Every other command.
+  METRIC_PARSE,          /// Reading a command, under the jobs lock for text files.
+  METRIC_JOBS_WAIT,      /// Waiting for the jobs lock.
+  METRIC_SEAT_WR_WAIT,   /// Waiting for the seat locks of a reservation.
+  METRIC_SEAT_RD_WAIT,   /// Waiting for the seat locks of a SHOW.
+  METRIC_SEAT_HOLD,      /// Holding the seat locks of a reservation.
+  METRIC_OUT_WAIT,       /// Waiting for the .out file lock.
+  METRIC_OUT_HOLD,       /// Holding the .out file lock.
+  METRIC_STATE_DELAY,    /// Sleeping in each simulated state access.
+  METRIC_NUM_TIMERS
+};
+
+/// Events that are counted.
+enum MetricCounter {
+  METRIC_SEATS_RESERVED,     /// Seats of successful reservations.
+  METRIC_RESERVE_CONFLICTS,  /// Reservations that found a seat already taken.
+  METRIC_RESERVE_BEST_RETRY, /// RESERVE_BEST searches started over after a conflict.
+  METRIC_OUTPUT_BYTES,       /// Bytes written to the .out file.
+  METRIC_NUM_COUNTERS
+};
+
+/// Counters and latency histograms of a .jobs file, kept by each thread that
+/// runs it in a slot of its own and only added up when they are written.
+struct Metrics;
+
+/// Creates the metrics of a .jobs file.
+/// @param jobs_path Path of the .jobs file, whose extension is replaced by
+/// .stats for the path of the metrics.
+/// @return Newly created metrics, NULL on failure.
+struct Metrics *metrics_create(const char *jobs_path);
+
+/// Writes the metrics to their .stats file: a line per counter, a line per timer
+/// with its count, mean, percentiles and maximum, then a line per non-empty
+/// histogram bucket with its largest value and its count.
+/// @note No thread may still be recording into the metrics.
+/// @param metrics Metrics to be written.
+/// @return 0 if the file was written successfully, 1 otherwise.
+int metrics_write(struct Metrics *metrics);
+
+/// Frees the metrics and the slots of their threads.
+/// @param metrics Metrics to be freed.
+void metrics_destroy(struct Metrics *metrics);
+
+/// Makes the calling thread record into its slot of the given metrics, which is
+/// created the first time.
+/// @note Only takes the lock of the metrics when the thread changes metrics.
+/// @param metrics Metrics to record into, NULL to stop recording.
+void metrics_attach(struct Metrics *metrics);
+
+/// Starts timing a latency of the calling thread.
+/// @param timer Latency to be timed.
+void metrics_begin(enum MetricTimer timer);
+
+/// Stops timing a latency of the calling thread and records it.
+/// @param timer Latency started with metrics_begin.
+void metrics_end(enum MetricTimer timer);
+
+/// Adds to a counter of the calling thread.
+/// @param counter Counter to be increased.
+/// @param value Amount to be added.
+void metrics_add(enum MetricCounter counter, uint64_t value);
+
+/// Gets the timer of a command.
+/// @param command Command that was read.
+/// @return The timer of the command.
+enum MetricTimer metrics_command_timer(enum Command command);
+
+// The hot paths only use these macros, which leave no code behind when the
+// metrics are disabled.
+#if EMS_METRICS
+#define METRICS_ATTACH(metrics) metrics_attach(metrics)
+#define METRICS_BEGIN(timer) metrics_begin(timer)
+#define METRICS_END(timer) metrics_end(timer)
+#define METRICS_ADD(counter, value) metrics_add((counter), (uint64_t)(value))
+#else
+#define METRICS_ATTACH(metrics) ((void)0)
+#define METRICS_BEGIN(timer) ((void)0)
+#define METRICS_END(timer) ((void)0)
+#define METRICS_ADD(counter, value) ((void)0)
+#endif
+
+#endif // EMS_METRICS_H
@@ -1,5 +1,7 @@
 #include "operations.h"
 
+#include <limits.h>
+#include <stdalign.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -7,157 +9,272 @@
 #include <unistd.h>
 #include <pthread.h>
 
+#include "arena.h"
 #include "eventlist.h"
+#include "jobsbin.h"
+#include "jobsmap.h"
+#include "metrics.h"
 #include "parser.h"
+#include "seatlock.h"
 #include "constants.h"
 
-#define MAX_UINT 4294967295
+#define UINT_DIGITS 10 // Number of digits of the largest unsigned int
+#define EVENT_PREFIX "Event: "
+#define STATS_LINE_MAX 96 // Longest line of STATS, with its newline
+#define SEAT_SORT_SMALL 16 // Longest seat list that is insertion sorted instead of radix sorted
 
 static struct EventList *event_list = NULL;
+static _Thread_local struct EventList *attached_list = NULL;
+static _Thread_local struct OutBuffer *captured_output = NULL;
 static unsigned int state_access_delay_ms = 0;
+static enum LockMode lock_mode = LOCK_STRIPED;
+
+/// Scratch buffers of a thread, reused across calls.
+struct Scratch {
+  char *buffer;
+  size_t size;
+  struct Coords coords; /// Coordinates of the RESERVE being run.
+};
+
+static struct Scratch *thread_scratch(void);
+
+/// Unlocks the jobs file, if it is being read under a lock, once the command has
+/// been read.
+/// @param rd_jobs_mutex Mutex of the jobs file, NULL if it is not used.
+static void unlock_jobs(pthread_mutex_t *rd_jobs_mutex) {
+  METRICS_END(METRIC_PARSE);
+  if (rd_jobs_mutex != NULL) {
+    safe_mutex_unlock(rd_jobs_mutex);
+  }
+}
 
-/* Main thread function */
-void *thread_func(void *args) {
-  struct thread_args *thread_args = (struct thread_args*) args;
+/// Waits for every thread to reach the BARRIER and moves the jobs file past it.
+/// @note The BARRIER stays visible until every thread has reached it, so all the
+/// threads agree on it.
+/// @param thread_args Arguments of the calling thread.
+static void pass_barrier(struct thread_args *thread_args) {
+  // Only one thread moves the jobs file to the next segment.
+  if (safe_barrier_wait(thread_args->segment_barrier)) {
+    if (thread_args->jobs_map != NULL) {
+      jobsmap_next_segment(thread_args->jobs_map);
+    } else {
+      cleanup(thread_args->jobs);
+    }
+  }
+
+  // Waits again so that no thread reads the next segment before it is ready.
+  safe_barrier_wait(thread_args->segment_barrier);
+}
+
+void wait_pending_delay(struct thread_args *thread_args) {
+  // Other threads may add to the delay at any time, so it is taken in one step.
+  unsigned int delay = atomic_exchange(&thread_args->delays[thread_args->id], 0);
+
+  if (delay > 0) {
+    ems_wait(delay);
+  }
+}
+
+enum Command run_command(struct thread_args *thread_args, struct Reader *reader,
+                         pthread_mutex_t *rd_jobs_mutex) {
   int id = thread_args->id;
-  int jobs_fd = thread_args->jobs_fd;
   int out_fd = thread_args->out_fd;
   int MAX_THREADS = thread_args->MAX_THREADS;
-  unsigned int *delays = thread_args->delays;
-  pthread_mutex_t *rd_jobs_mutex = thread_args->rd_jobs_mutex;
+  atomic_uint *delays = thread_args->delays;
   pthread_mutex_t *wr_out_mutex = thread_args->wr_out_mutex;
-  pthread_mutex_t *reservation = thread_args->reservation;
-  pthread_rwlock_t *rwlock_events = thread_args->rwlock_events;
+  const struct JobsDecoder *decoder = jobsbin_decoder(thread_args->jobs_map);
 
-  int exitFlag = 0;
-  int *ret_value = (int*) safe_malloc(sizeof(int));
+  unsigned int event_id, delay, thread_id = 0;
+  size_t num_rows, num_columns, num_coords, num_seats, row_hint;
+  struct Scratch *scratch;
 
-  while (1) {
-    unsigned int event_id, delay, thread_id = 0;
-    size_t num_rows, num_columns, num_coords;
-    size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  METRICS_ATTACH(thread_args->metrics);
+  METRICS_BEGIN(METRIC_PARSE);
 
-    if (delays[id] > 0) {
-      ems_wait(delays[id]);
-      delays[id] = 0;
-    }
+  enum Command command = decoder->get_next(reader);
+  METRICS_BEGIN(metrics_command_timer(command));
+  switch (command) {
+    case CMD_CREATE:
+      if (decoder->parse_create(reader, &event_id, &num_rows, &num_columns) != 0) {
+        unlock_jobs(rd_jobs_mutex);
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        break;
+      }
+      unlock_jobs(rd_jobs_mutex);
+      if (ems_create(event_id, num_rows, num_columns)) {
+        fprintf(stderr, "Failed to create event\n");
+      }
+      break;
 
-    // Mutex lock so that only one thread can read from the jobs file at a time.
-    safe_mutex_lock(rd_jobs_mutex);
-    switch (get_next(jobs_fd)) {
-      case CMD_CREATE:
-        if (parse_create(jobs_fd, &event_id, &num_rows, &num_columns) != 0) {
-          safe_mutex_unlock(rd_jobs_mutex);
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        }
-        safe_mutex_unlock(rd_jobs_mutex);
-        if (ems_create(event_id, num_rows, num_columns, rwlock_events)) {
-          fprintf(stderr, "Failed to create event\n");
-        }
+    case CMD_RESERVE:
+      scratch = thread_scratch();
+      if (scratch == NULL) {
+        unlock_jobs(rd_jobs_mutex);
+        fprintf(stderr, "Error allocating memory for coordinates\n");
         break;
+      }
 
-      case CMD_RESERVE:
-        num_coords =
-            parse_reserve(jobs_fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
-        safe_mutex_unlock(rd_jobs_mutex);
+      num_coords = decoder->parse_reserve(reader, &event_id, &scratch->coords);
+      unlock_jobs(rd_jobs_mutex);
 
-        if (num_coords == 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        }
+      if (num_coords == 0) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        break;
+      }
 
-        sortReserve(xs, ys, num_coords);
+      if (ems_reserve(event_id, num_coords, scratch->coords.xs, scratch->coords.ys)) {
+        fprintf(stderr, "Failed to reserve seats\n");
+      }
+      break;
 
-        if (ems_reserve(event_id, num_coords, xs, ys, reservation)) {
-          fprintf(stderr, "Failed to reserve seats\n");
-        }
+    case CMD_RESERVE_BEST:
+      if (decoder->parse_reserve_best(reader, &event_id, &num_seats, &row_hint) != 0) {
+        unlock_jobs(rd_jobs_mutex);
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
         break;
+      }
+      unlock_jobs(rd_jobs_mutex);
 
-      case CMD_SHOW:
-        if (parse_show(jobs_fd, &event_id) != 0) {
-          safe_mutex_unlock(rd_jobs_mutex);
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        }
-        safe_mutex_unlock(rd_jobs_mutex);
+      if (ems_reserve_best(event_id, num_seats, row_hint)) {
+        fprintf(stderr, "Failed to reserve seats\n");
+      }
+      break;
 
-        if (ems_show(event_id, out_fd, wr_out_mutex)) {
-          fprintf(stderr, "Failed to show event\n");
-        }
+    case CMD_SHOW:
+      if (decoder->parse_show(reader, &event_id) != 0) {
+        unlock_jobs(rd_jobs_mutex);
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
         break;
+      }
+      unlock_jobs(rd_jobs_mutex);
 
-      case CMD_LIST_EVENTS:
-        safe_mutex_unlock(rd_jobs_mutex);
+      if (ems_show(event_id, out_fd, wr_out_mutex)) {
+        fprintf(stderr, "Failed to show event\n");
+      }
+      break;
 
-        if (ems_list_events(out_fd, wr_out_mutex)) {
-          fprintf(stderr, "Failed to list events\n");
-        }
-        break;
+    case CMD_LIST_EVENTS:
+      unlock_jobs(rd_jobs_mutex);
 
-      case CMD_WAIT:
-        int wait = parse_wait(jobs_fd, &delay, &thread_id);
-        safe_mutex_unlock(rd_jobs_mutex);
-
-        if (wait == -1) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        } else if (wait == 0) {
-          for (int i = 0; i < MAX_THREADS; i++) {
-            if (i != id) {
-              delays[i] += delay;
-            }
-          }
-          ems_wait(delay);
-        } else {
-          delays[thread_id-1] += delay;
-        }
+      if (ems_list_events(out_fd, wr_out_mutex)) {
+        fprintf(stderr, "Failed to list events\n");
+      }
+      break;
 
-        break;
+    case CMD_STATS:
+      int stats = decoder->parse_stats(reader, &event_id);
+      unlock_jobs(rd_jobs_mutex);
 
-      case CMD_INVALID:
-        safe_mutex_unlock(rd_jobs_mutex);
+      if (stats == -1) {
         fprintf(stderr, "Invalid command. See HELP for usage\n");
         break;
+      }
 
-      case CMD_HELP:
-        safe_mutex_unlock(rd_jobs_mutex);
-        printf(
-          "Available commands:\n"
-          "  CREATE <event_id> <num_rows> <num_columns>\n"
-          "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
-          "  SHOW <event_id>\n"
-          "  LIST\n"
-          "  WAIT <delay_ms> [thread_id]\n"
-          "  BARRIER\n"
-          "  HELP\n");
+      if ((stats == 1 ? ems_stats(event_id, out_fd, wr_out_mutex)
+                      : ems_stats_all(out_fd, wr_out_mutex)) != 0) {
+        fprintf(stderr, "Failed to show stats\n");
+      }
+      break;
+
+    case CMD_WAIT:
+      int wait = decoder->parse_wait(reader, &delay, &thread_id);
+      unlock_jobs(rd_jobs_mutex);
 
+      if (wait == -1) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
         break;
+      } else if (wait == 0) {
+        for (int i = 0; i < MAX_THREADS; i++) {
+          if (i != id) {
+            atomic_fetch_add(&delays[i], delay);
+          }
+        }
+        ems_wait(delay);
+      } else {
+        atomic_fetch_add(&delays[thread_id-1], delay);
+      }
 
-      case CMD_BARRIER:
-        safe_mutex_unlock(rd_jobs_mutex);
-        *ret_value = 1;
-        exitFlag = 1;
+      break;
 
-        break;
+    case CMD_INVALID:
+      unlock_jobs(rd_jobs_mutex);
+      fprintf(stderr, "Invalid command. See HELP for usage\n");
+      break;
 
-      case CMD_EMPTY:
-        safe_mutex_unlock(rd_jobs_mutex);
-        break;
+    case CMD_HELP:
+      unlock_jobs(rd_jobs_mutex);
+      printf(
+        "Available commands:\n"
+        "  CREATE <event_id> <num_rows> <num_columns>\n"
+        "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+        "  RESERVE_BEST <event_id> <num_seats> [row]\n"
+        "  SHOW <event_id>\n"
+        "  LIST\n"
+        "  STATS [event_id]\n"
+        "  WAIT <delay_ms> [thread_id]\n"
+        "  BARRIER\n"
+        "  HELP\n");
 
-      case EOC:
-        safe_mutex_unlock(rd_jobs_mutex);
-        *ret_value = 0;
-        exitFlag = 1;
+      break;
 
-        break;
+    case CMD_BARRIER:
+      unlock_jobs(rd_jobs_mutex);
+      break;
+
+    case CMD_EMPTY:
+      unlock_jobs(rd_jobs_mutex);
+      break;
+
+    case EOC:
+      unlock_jobs(rd_jobs_mutex);
+      break;
+  }
+
+  METRICS_END(metrics_command_timer(command));
+  return command;
+}
+
+/* Main thread function */
+void *thread_func(void *args) {
+  struct thread_args *thread_args = (struct thread_args*) args;
+  struct Reader *jobs = thread_args->jobs;
+  struct JobsMap *jobs_map = thread_args->jobs_map;
+  // Mapped .jobs files are parsed without the lock.
+  pthread_mutex_t *rd_jobs_mutex = jobs_map == NULL ? thread_args->rd_jobs_mutex : NULL;
+
+  while (1) {
+    wait_pending_delay(thread_args);
+
+    struct Reader line;
+    struct Reader *reader = jobs;
+
+    if (jobs_map != NULL) {
+      // Each thread claims a whole line and parses it on its own.
+      if (jobsmap_claim(jobs_map, &line) != 0) {
+        if (!jobsmap_at_barrier(jobs_map)) {
+          break;
+        }
+        pass_barrier(thread_args);
+        continue;
       }
+      reader = &line;
+    } else {
+      // Mutex lock so that only one thread can read from the jobs file at a time.
+      METRICS_ATTACH(thread_args->metrics);
+      METRICS_BEGIN(METRIC_JOBS_WAIT);
+      safe_mutex_lock(rd_jobs_mutex);
+      METRICS_END(METRIC_JOBS_WAIT);
+    }
 
-      if (exitFlag == 1) {
-        free(thread_args);
-        return ret_value;
+    enum Command command = run_command(thread_args, reader, rd_jobs_mutex);
+    if (command == CMD_BARRIER) {
+      pass_barrier(thread_args);
+    } else if (command == EOC) {
+      break;
     }
   }
+
+  return NULL;
 }
 
 /* Auxiliary functions */
@@ -177,6 +294,17 @@ void safe_mutex_init(pthread_mutex_t *mutex) {
   }
 }
 
+void safe_mutex_init_shared(pthread_mutex_t *mutex) {
+  pthread_mutexattr_t attr;
+  if (pthread_mutexattr_init(&attr) != 0 ||
+      pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+      pthread_mutex_init(mutex, &attr) != 0) {
+    fprintf(stderr, "Failed to init shared mutex\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutexattr_destroy(&attr);
+}
+
 void safe_mutex_lock(pthread_mutex_t *mutex) {
   if (pthread_mutex_lock(mutex) != 0) {
     fprintf(stderr, "Failed to lock mutex\n");
@@ -205,6 +333,17 @@ void safe_rwlock_init(pthread_rwlock_t *rwl) {
   }
 }
 
+void safe_rwlock_init_shared(pthread_rwlock_t *rwl) {
+  pthread_rwlockattr_t attr;
+  if (pthread_rwlockattr_init(&attr) != 0 ||
+      pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+      pthread_rwlock_init(rwl, &attr) != 0) {
+    fprintf(stderr, "Failed to init shared rwlock\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_rwlockattr_destroy(&attr);
+}
+
 void safe_rwlock_wrlock(pthread_rwlock_t *rwl) {
   if (pthread_rwlock_wrlock(rwl) != 0) {
     fprintf(stderr, "Failed to lock rw_wrlock\n");
@@ -233,11 +372,73 @@ void safe_rwlock_destroy(pthread_rwlock_t *rwl) {
   }
 }
 
-int write_to_out(int out_fd, char *buffer) {
+void safe_barrier_init(pthread_barrier_t *barrier, unsigned int count) {
+  if (pthread_barrier_init(barrier, NULL, count) != 0) {
+    fprintf(stderr, "Failed to init barrier\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+int safe_barrier_wait(pthread_barrier_t *barrier) {
+  int ret = pthread_barrier_wait(barrier);
+  if (ret != 0 && ret != PTHREAD_BARRIER_SERIAL_THREAD) {
+    fprintf(stderr, "Failed to wait on barrier\n");
+    exit(EXIT_FAILURE);
+  }
+  return ret == PTHREAD_BARRIER_SERIAL_THREAD;
+}
+
+void safe_barrier_destroy(pthread_barrier_t *barrier) {
+  if (pthread_barrier_destroy(barrier) != 0) {
+    fprintf(stderr, "Failed to destroy barrier\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void safe_cond_init(pthread_cond_t *cond) {
+  if (pthread_cond_init(cond, NULL) != 0) {
+    fprintf(stderr, "Failed to init condition variable\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void safe_cond_init_shared(pthread_cond_t *cond) {
+  pthread_condattr_t attr;
+  if (pthread_condattr_init(&attr) != 0 ||
+      pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+      pthread_cond_init(cond, &attr) != 0) {
+    fprintf(stderr, "Failed to init shared condition variable\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_condattr_destroy(&attr);
+}
+
+void safe_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+  if (pthread_cond_wait(cond, mutex) != 0) {
+    fprintf(stderr, "Failed to wait on condition variable\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void safe_cond_broadcast(pthread_cond_t *cond) {
+  if (pthread_cond_broadcast(cond) != 0) {
+    fprintf(stderr, "Failed to broadcast condition variable\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void safe_cond_destroy(pthread_cond_t *cond) {
+  if (pthread_cond_destroy(cond) != 0) {
+    fprintf(stderr, "Failed to destroy condition variable\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+int write_all(int out_fd, const char *buffer, size_t len) {
   ssize_t numWritten = 0;
-  size_t done = 0, len = strlen(buffer);
+  size_t done = 0;
 
-  while ((numWritten = write(out_fd, buffer+done, len)) > 0) {
+  while (len > 0 && (numWritten = write(out_fd, buffer+done, len)) > 0) {
     done += (size_t)numWritten;
     len = len - (size_t)numWritten;
   }
@@ -250,52 +451,125 @@ int write_to_out(int out_fd, char *buffer) {
   return 0;
 }
 
-char* realloc_and_copy(char *buffer, size_t size, const char *str) {
-  buffer = (char*) realloc(buffer, size);
-  if (buffer == NULL) {
-    fprintf(stderr, "Error allocating memory for buffer\n");
-    return NULL;
+int outbuffer_append(struct OutBuffer *buffer, const char *bytes, size_t len) {
+  if (buffer->len + len > buffer->capacity) {
+    size_t capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+    while (capacity < buffer->len + len) {
+      capacity *= 2;
+    }
+
+    char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+      fprintf(stderr, "Error allocating memory for output\n");
+      return 1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
   }
 
-  strcpy(buffer, str);
-  return buffer;
+  memcpy(buffer->data + buffer->len, bytes, len);
+  buffer->len += len;
+  return 0;
 }
 
-int compareSeats(const void *a, const void *b) {
-  size_t *x = (size_t *)a;
-  size_t *y = (size_t *)b;
+int write_to_out(int out_fd, char *buffer) {
+  return write_all(out_fd, buffer, strlen(buffer));
+}
 
-  if (x[0] < y[0]) {
-    return -1;
-  } else if (x[0] > y[0]) {
-    return 1;
-  } else {
-    if (x[1] < y[1]) {
-      return -1;
-    } else if (x[1] > y[1]) {
-      return 1;
-    } else {
-      return 0;
-    }
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+static void free_scratch(void *ptr) {
+  struct Scratch *scratch = (struct Scratch *)ptr;
+  free(scratch->buffer);
+  coords_destroy(&scratch->coords);
+  free(scratch);
+}
+
+static void create_scratch_key(void) {
+  if (pthread_key_create(&scratch_key, free_scratch) != 0) {
+    fprintf(stderr, "Failed to create scratch key\n");
+    exit(EXIT_FAILURE);
   }
 }
 
-void sortReserve(size_t *xs, size_t *ys, size_t num_seats) {
-  size_t pairs[num_seats][2];
+/// Gets the scratch buffers of the calling thread, creating them if needed.
+/// @note The buffers are freed when the thread exits.
+/// @return Pointer to the buffers, NULL on failure.
+static struct Scratch *thread_scratch(void) {
+  pthread_once(&scratch_once, create_scratch_key);
+
+  struct Scratch *scratch = (struct Scratch *)pthread_getspecific(scratch_key);
+  if (scratch == NULL) {
+    scratch = (struct Scratch *)calloc(1, sizeof(struct Scratch));
+    if (scratch == NULL || pthread_setspecific(scratch_key, scratch) != 0) {
+      free(scratch);
+      return NULL;
+    }
+  }
 
-  for (size_t i = 0; i < num_seats; i++) {
-    pairs[i][0] = xs[i];
-    pairs[i][1] = ys[i];
+  return scratch;
+}
+
+/// Gets the scratch buffer of the calling thread, growing it if needed.
+/// @param size Minimum size of the buffer.
+/// @return Pointer to the buffer, NULL on failure.
+static char *get_scratch(size_t size) {
+  struct Scratch *scratch = thread_scratch();
+  if (scratch == NULL) {
+    return NULL;
   }
 
-  qsort(pairs, num_seats, sizeof(pairs[0]), compareSeats);
+  if (scratch->size < size || scratch->buffer == NULL) {
+    size_t new_size = scratch->size > 0 ? scratch->size : 4096;
+    while (new_size < size) {
+      new_size *= 2;
+    }
 
-  for (size_t i = 0; i < num_seats; i++) {
-    xs[i] = pairs[i][0];
-    ys[i] = pairs[i][1];
+    char *buffer = (char *)realloc(scratch->buffer, new_size);
+    if (buffer == NULL) {
+      return NULL;
+    }
+    scratch->buffer = buffer;
+    scratch->size = new_size;
   }
+
+  return scratch->buffer;
 }
 
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/// Writes the decimal digits of a number, without a terminator.
+/// @param value Number to be written.
+/// @param dst Buffer with room for at least UINT_DIGITS characters.
+/// @return Number of characters written.
+static size_t utoa(unsigned int value, char *dst) {
+  size_t len = 1;
+  for (unsigned int v = value; v >= 10; v /= 10) {
+    len++;
+  }
+
+  // Writes two digits at a time, from the end.
+  char *p = dst + len;
+  while (value >= 100) {
+    unsigned int pair = (value % 100) * 2;
+    value /= 100;
+    *--p = digit_pairs[pair + 1];
+    *--p = digit_pairs[pair];
+  }
+
+  if (value >= 10) {
+    *--p = digit_pairs[value * 2 + 1];
+    *--p = digit_pairs[value * 2];
+  } else {
+    *--p = (char)('0' + value);
+  }
+
+  return len;
+}
 
 /// Calculates a timespec from a delay in milliseconds.
 /// @param delay_ms Delay in milliseconds.
@@ -304,16 +578,59 @@ static struct timespec delay_to_timespec(unsigned int delay_ms) {
   return (struct timespec){delay_ms / 1000, (delay_ms % 1000) * 1000000};
 }
 
+/// Writes the output of a command to the .out file, or appends it to the buffer
+/// that captures the output of the calling thread.
+/// @param out_fd File descriptor of the .out file.
+/// @param wr_out_mutex Mutex to be used to write to the output file.
+/// @param output Bytes to be written.
+/// @param len Number of bytes.
+/// @return 0 if the output was written successfully, 1 otherwise.
+static int emit_output(int out_fd, pthread_mutex_t *wr_out_mutex, const char *output,
+                       size_t len) {
+  if (captured_output != NULL) {
+    return outbuffer_append(captured_output, output, len);
+  }
+
+  // Mutex lock so that no other thread can write to the output file while it is being written to.
+  METRICS_BEGIN(METRIC_OUT_WAIT);
+  safe_mutex_lock(wr_out_mutex);
+  METRICS_END(METRIC_OUT_WAIT);
+  METRICS_BEGIN(METRIC_OUT_HOLD);
+  int failed = write_all(out_fd, output, len);
+  safe_mutex_unlock(wr_out_mutex);
+  METRICS_END(METRIC_OUT_HOLD);
+
+  if (failed) {
+    return 1;
+  }
+
+  METRICS_ADD(METRIC_OUTPUT_BYTES, len);
+  return 0;
+}
+
+/// Gets the events of the calling thread.
+/// @return The state attached to the thread, or the global state if there is none.
+static struct EventList *current_list() {
+  return attached_list != NULL ? attached_list : event_list;
+}
+
+/// Waits to simulate a real system accessing a costly memory resource.
+static void wait_state_access(void) {
+  struct timespec delay = delay_to_timespec(state_access_delay_ms);
+  METRICS_BEGIN(METRIC_STATE_DELAY);
+  nanosleep(&delay, NULL); // Should not be removed
+  METRICS_END(METRIC_STATE_DELAY);
+}
+
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory
 /// resource.
 /// @param event_id The ID of the event to get.
 /// @return Pointer to the event if found, NULL otherwise.
 static struct Event *get_event_with_delay(unsigned int event_id) {
-  struct timespec delay = delay_to_timespec(state_access_delay_ms);
-  nanosleep(&delay, NULL); // Should not be removed
+  wait_state_access();
 
-  return get_event(event_list, event_id);
+  return get_event(current_list(), event_id);
 }
 
 /// Gets the seat with the given index from the state.
@@ -322,13 +639,31 @@ static struct Event *get_event_with_delay(unsigned int event_id) {
 /// @param event Event to get the seat from.
 /// @param index Index of the seat to get.
 /// @return Pointer to the seat.
-static unsigned int *get_seat_with_delay(struct Event *event, size_t index) {
-  struct timespec delay = delay_to_timespec(state_access_delay_ms);
-  nanosleep(&delay, NULL); // Should not be removed
+static atomic_uint *get_seat_with_delay(struct Event *event, size_t index) {
+  wait_state_access();
 
   return &event->data[index];
 }
 
+/// Copies all the seats of an event from the state.
+/// @note Will wait once for the whole copy, to simulate a real system reading a
+/// costly memory resource in one block.
+/// @param event Event to get the seats from.
+/// @param dst Array of rows * cols entries that receives the seats.
+static void get_seats_with_delay(struct Event *event, unsigned int *dst) {
+  wait_state_access();
+
+  seatlock_snapshot(event, dst);
+}
+
+/// Rounds an offset up to an alignment.
+/// @param offset Offset to be rounded.
+/// @param alignment Alignment, a power of two.
+/// @return Rounded offset.
+static size_t align_to(size_t offset, size_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
 /// Gets the index of a seat.
 /// @note This function assumes that the seat exists.
 /// @param event Event to get the seat index from.
@@ -339,16 +674,82 @@ static size_t seat_index(struct Event *event, size_t row, size_t col) {
   return (row - 1) * event->cols + col - 1;
 }
 
-int ems_init(unsigned int delay_ms) {
+size_t sort_seats(size_t *seats, size_t *tmp, size_t num_seats, size_t num_event_seats) {
+  size_t *sorted = seats;
+
+  if (num_seats <= SEAT_SORT_SMALL) {
+    for (size_t i = 1; i < num_seats; i++) {
+      size_t seat = seats[i];
+      size_t j = i;
+      for (; j > 0 && seats[j - 1] > seat; j--) {
+        seats[j] = seats[j - 1];
+      }
+      seats[j] = seat;
+    }
+  } else {
+    size_t *src = seats;
+    size_t *dst = tmp;
+    for (unsigned int shift = 0; shift < sizeof(size_t) * CHAR_BIT &&
+                                 ((num_event_seats - 1) >> shift) != 0;
+         shift += 8) {
+      size_t counts[256] = {0};
+      for (size_t i = 0; i < num_seats; i++) {
+        counts[(src[i] >> shift) & 0xff]++;
+      }
+
+      size_t offset = 0;
+      for (size_t digit = 0; digit < 256; digit++) {
+        size_t count = counts[digit];
+        counts[digit] = offset;
+        offset += count;
+      }
+
+      for (size_t i = 0; i < num_seats; i++) {
+        dst[counts[(src[i] >> shift) & 0xff]++] = src[i];
+      }
+
+      size_t *swap = src;
+      src = dst;
+      dst = swap;
+    }
+    sorted = src;
+  }
+
+  // Duplicates are next to each other once sorted, and are dropped while the
+  // seats are moved back into place.
+  size_t num_distinct = 0;
+  for (size_t i = 0; i < num_seats; i++) {
+    if (num_distinct == 0 || seats[num_distinct - 1] != sorted[i]) {
+      seats[num_distinct++] = sorted[i];
+    }
+  }
+
+  return num_distinct;
+}
+
+int ems_init(unsigned int delay_ms, enum LockMode mode, int shared) {
   if (event_list != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
     return 1;
   }
 
-  event_list = create_list();
+  // All of the state lives in one arena. A shared arena must be created before
+  // forking, so that every child maps it.
+  struct Arena *arena = arena_create(EMS_ARENA_SIZE, shared);
+  if (arena == NULL) {
+    return 1;
+  }
+
+  event_list = create_list(arena);
   state_access_delay_ms = delay_ms;
+  lock_mode = mode;
 
-  return event_list == NULL;
+  if (event_list == NULL) {
+    arena_destroy(arena);
+    return 1;
+  }
+
+  return 0;
 }
 
 int ems_terminate() {
@@ -357,12 +758,41 @@ int ems_terminate() {
     return 1;
   }
 
+  struct Arena *arena = event_list->arena;
   free_list(event_list);
+  arena_destroy(arena);
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols,
-               pthread_rwlock_t *rwlock_events) {
+struct EventList *ems_state_create() {
+  struct Arena *arena = arena_create(EMS_ARENA_SIZE, 0);
+  if (arena == NULL) {
+    return NULL;
+  }
+
+  struct EventList *list = create_list(arena);
+  if (list == NULL) {
+    arena_destroy(arena);
+  }
+
+  return list;
+}
+
+void ems_state_destroy(struct EventList *state) {
+  struct Arena *arena = state->arena;
+  free_list(state);
+  arena_destroy(arena);
+}
+
+void ems_state_attach(struct EventList *state) {
+  attached_list = state;
+}
+
+void ems_capture_output(struct OutBuffer *buffer) {
+  captured_output = buffer;
+}
+
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
@@ -373,58 +803,113 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols,
     return 1;
   }
 
-  struct Event *event = malloc(sizeof(struct Event));
+  // The event, its seats and its locks are a single block of the arena. A compact seat
+  // map is changed a row at a time, so it needs row locks unless the event has an owner.
+  struct EventList *list = current_list();
+  struct Arena *arena = list->arena;
+  int compact = seatmap_is_compact(num_rows, num_cols);
+  enum LockMode mode = compact && lock_mode != LOCK_NONE ? LOCK_ROW : lock_mode;
+  size_t num_locks = seatlock_count(mode, num_rows, num_cols);
+  size_t data_offset = align_to(sizeof(struct Event), alignof(_Atomic uint64_t));
+  size_t locks_offset =
+      align_to(data_offset + seatmap_size(num_rows, num_cols), alignof(pthread_rwlock_t));
+  size_t block_size = locks_offset + num_locks * sizeof(pthread_rwlock_t);
+
+  struct Event *event = arena_alloc(arena, block_size);
 
   if (event == NULL) {
     fprintf(stderr, "Error allocating memory for event\n");
     return 1;
   }
 
+  event->block_size = block_size;
   event->id = event_id;
   event->rows = num_rows;
   event->cols = num_cols;
-  event->reservations = 0;
-  event->data = malloc(num_rows * num_cols * sizeof(unsigned int));
+  atomic_init(&event->reservations, 0);
+  seatmap_init(event, (char *)event + data_offset);
 
-  if (event->data == NULL) {
-    fprintf(stderr, "Error allocating memory for event data\n");
-    free(event);
+  seatlock_init(event, mode, (pthread_rwlock_t *)((char *)event + locks_offset),
+                arena->shared);
+
+  if (append_to_list(list, event) != 0) {
+    fprintf(stderr, "Error appending event to list\n");
+    seatlock_destroy(event);
+    arena_free(arena, event, block_size);
     return 1;
   }
 
-  for (size_t i = 0; i < num_rows * num_cols; i++) {
-    event->data[i] = 0;
-  }
+  return 0;
+}
 
-  event->locks = malloc(num_rows * num_cols * sizeof(pthread_rwlock_t));
+/// Reserves seats of an event, all or none of them.
+/// @param event Event that owns the seats.
+/// @param seats Distinct indexes of the seats, in increasing order.
+/// @param num_seats Number of seats.
+/// @param held Array of num_seats entries for the locks taken.
+/// @return 0 if the seats were reserved, 1 if one of them is already reserved,
+/// -1 on failure.
+static int reserve_seats(struct Event *event, const size_t *seats, size_t num_seats,
+                         size_t *held) {
+  // The id is taken from the per-event counter, so reservations for different events
+  // never contend with each other.
+  unsigned int reservation_id = atomic_fetch_add(&event->reservations, 1) + 1;
+
+  // Every lock covering the seats is write-locked during the reservation to ensure that
+  // no other thread can reserve the same seats. It also ensures that no other thread can
+  // show the seats while they are being reserved. In LOCK_ATOMIC mode no lock is taken and
+  // each seat is claimed with a compare-and-swap instead.
+  size_t num_held = seatlock_wrlock_all(event, seats, num_seats, held);
+
+  int result = 0;
+  if (event->data == NULL) {
+    for (size_t i = 0; i < num_seats; i++) {
+      wait_state_access();
+    }
 
-  if (event->locks == NULL) {
-    fprintf(stderr, "Error allocating memory for event locks\n");
-    free(event->data);
-    free(event);
-    return 1;
+    // A compact seat map checks every seat before it changes any, so nothing is undone.
+    result = seatmap_reserve(event, current_list()->arena, seats, num_seats, reservation_id);
+  } else {
+    size_t i = 0;
+    for (; i < num_seats; i++) {
+      unsigned int free_seat = 0;
+      if (!atomic_compare_exchange_strong(get_seat_with_delay(event, seats[i]), &free_seat,
+                                          reservation_id)) {
+        break;
+      }
+    }
+
+    // If the reservation was not successful, free the seats that were reserved.
+    if (i < num_seats) {
+      for (size_t j = 0; j < i; j++) {
+        unsigned int claimed = reservation_id;
+        atomic_compare_exchange_strong(get_seat_with_delay(event, seats[j]), &claimed, 0);
+      }
+      result = 1;
+    } else {
+      seatmap_mark(event, seats, num_seats);
+    }
   }
 
-  for (size_t i = 0; i < num_rows * num_cols; i++) {
-    safe_rwlock_init(&event->locks[i]);
+  if (result == 0) {
+    METRICS_ADD(METRIC_SEATS_RESERVED, num_seats);
+  } else if (result == 1) {
+    METRICS_ADD(METRIC_RESERVE_CONFLICTS, 1);
   }
 
-  if (append_to_list(event_list, event, rwlock_events) != 0) {
-    fprintf(stderr, "Error appending event to list\n");
-    free(event->data);
-    for (size_t i = 0; i < num_rows * num_cols; i++) {
-      safe_rwlock_destroy(&event->locks[i]);
-    }
-    free(event->locks);
-    free(event);
-    return 1;
+  if (result != 0) {
+    // The id is only given back if no later reservation took one in the meantime,
+    // otherwise two reservations could end up with the same id.
+    unsigned int last_id = reservation_id;
+    atomic_compare_exchange_strong(&event->reservations, &last_id, reservation_id - 1);
   }
 
-  return 0;
+  seatlock_unlock_all(event, held, num_held);
+
+  return result;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys,
-                pthread_mutex_t *reservation) {
+int ems_reserve(unsigned int event_id, size_t num_seats, const uint32_t *xs, const uint32_t *ys) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
@@ -437,53 +922,85 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys,
     return 1;
   }
 
-  safe_mutex_lock(reservation);
-  unsigned int reservation_id = ++event->reservations;
-  safe_mutex_unlock(reservation);
-
-  size_t i = 0;
-  pthread_rwlock_t *locks = event->locks;
-  for (; i < num_seats; i++) {
-    size_t row = xs[i];
-    size_t col = ys[i];
+  // Reservations have no size limit, so the seat indexes, the room to sort them and
+  // the locks taken are kept in the scratch buffer of the thread rather than on the stack.
+  size_t *seats = (size_t *)(void *)get_scratch(3 * num_seats * sizeof(size_t));
+  if (seats == NULL) {
+    fprintf(stderr, "Error allocating memory for seats\n");
+    return 1;
+  }
+  size_t *tmp = seats + num_seats;
+  size_t *held = tmp + num_seats;
 
-    if (row <= 0 || row > event->rows || col <= 0 || col > event->cols) {
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
       fprintf(stderr, "Invalid seat\n");
-      break;
+      return 1;
     }
+    seats[i] = seat_index(event, xs[i], ys[i]);
+  }
 
-    // Each seat is write-locked during the reservation to ensure that no other thread
-    // can reserve the same seat. It also ensures that no other thread can show the event
-    // while it is being reserved.
-    safe_rwlock_wrlock(&locks[seat_index(event, row, col)]);
+  // Seats are handled in a fixed order, and a seat listed twice is only reserved once.
+  num_seats = sort_seats(seats, tmp, num_seats, event->rows * event->cols);
 
-    if (*get_seat_with_delay(event, seat_index(event, row, col)) != 0) {
-      safe_rwlock_unlock(&locks[seat_index(event, row, col)]);
-      fprintf(stderr, "Seat already reserved\n");
-      break;
-    }
+  int result = reserve_seats(event, seats, num_seats, held);
+  if (result == 1) {
+    fprintf(stderr, "Seat already reserved\n");
+  }
 
-    *get_seat_with_delay(event, seat_index(event, row, col)) = reservation_id;
+  return result != 0;
+}
+
+int ems_reserve_best(unsigned int event_id, size_t num_seats, size_t row_hint) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
   }
 
-  // If the reservation was not successful, free the seats that were reserved.
-  if (i < num_seats) {
-    safe_mutex_lock(reservation);
-    event->reservations--;
-    safe_mutex_unlock(reservation);
-    
-    for (size_t j = 0; j < i; j++) {
-      *get_seat_with_delay(event, seat_index(event, xs[j], ys[j])) = 0;
-      safe_rwlock_unlock(&locks[seat_index(event, xs[j], ys[j])]);
-    }
+  struct Event *event = get_event_with_delay(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  for (size_t j = 0; j < num_seats; j++) {
-    safe_rwlock_unlock(&locks[seat_index(event, xs[j], ys[j])]);
+  if (row_hint > event->rows) {
+    fprintf(stderr, "Invalid seat\n");
+    return 1;
   }
 
-  return 0;
+  // Rejected before the scratch is sized, which bounds it by the columns.
+  if (num_seats > event->cols) {
+    fprintf(stderr, "No consecutive free seats\n");
+    return 1;
+  }
+
+  size_t *seats = (size_t *)(void *)get_scratch(2 * num_seats * sizeof(size_t));
+  if (seats == NULL) {
+    fprintf(stderr, "Error allocating memory for seats\n");
+    return 1;
+  }
+  size_t *held = seats + num_seats;
+
+  while (1) {
+    size_t first;
+    if (seatmap_find_free(event, num_seats, row_hint > 0 ? row_hint - 1 : 0, &first) != 0) {
+      fprintf(stderr, "No consecutive free seats\n");
+      return 1;
+    }
+
+    for (size_t i = 0; i < num_seats; i++) {
+      seats[i] = first + i;
+    }
+
+    // The bitmap only shows finished reservations, so another thread may have taken
+    // the seats in the meantime. The search then starts over.
+    int result = reserve_seats(event, seats, num_seats, held);
+    if (result != 1) {
+      return result != 0;
+    }
+    METRICS_ADD(METRIC_RESERVE_BEST_RETRY, 1);
+  }
 }
 
 int ems_show(unsigned int event_id, int out_fd, pthread_mutex_t *wr_out_mutex) {
@@ -499,49 +1016,76 @@ int ems_show(unsigned int event_id, int out_fd, pthread_mutex_t *wr_out_mutex) {
     return 1;
   }
 
-  char *buffer = (char*) malloc((sizeof(MAX_UINT)+1) * event->cols * event->rows);
+  // The buffer holds a copy of the seats followed by the output, where every seat
+  // takes at most UINT_DIGITS digits plus a separator.
+  size_t num_seats = event->rows * event->cols;
+  char *buffer = get_scratch(num_seats * (sizeof(unsigned int) + UINT_DIGITS + 1));
 
   if (buffer == NULL) {
     fprintf(stderr, "Error allocating memory for buffer\n");
     return 1;
   }
-  buffer[0] = '\0';
 
-  pthread_rwlock_t *locks = event->locks;
+  // The seats are copied in one consistent step and the output is rendered from the
+  // private copy, without holding any lock.
+  unsigned int *seats = (unsigned int *)buffer;
+  get_seats_with_delay(event, seats);
 
-  // The output is copied to a buffer before writing to the output to reduce the time
-  // that the output file is locked.
-  // Each seat is read-locked during the copying to ensure better concurrency.
-  
-  for (size_t i = 1; i <= event->rows; i++) {
+  char *output = buffer + num_seats * sizeof(unsigned int);
+  char *cursor = output;
+  for (size_t i = 0; i < event->rows; i++) {
     for (size_t j = 1; j <= event->cols; j++) {
-      safe_rwlock_rdlock(&locks[seat_index(event, i, j)]);
-      unsigned int *seat = get_seat_with_delay(event, seat_index(event, i, j));
-      safe_rwlock_unlock(&locks[seat_index(event, i, j)]);
+      cursor += utoa(*seats++, cursor);
+      *cursor++ = j < event->cols ? ' ' : '\n';
+    }
+  }
 
-      char seat_as_char[sizeof(MAX_UINT) + 1];  // max size of uint + '\0'
-      sprintf(seat_as_char, "%u", *seat);
-      strcat(buffer, seat_as_char);
+  return emit_output(out_fd, wr_out_mutex, output, (size_t)(cursor - output));
+}
 
-      if (j < event->cols) {
-        strcat(buffer, " ");
-      }
-    }
-    strcat(buffer, "\n");
+/// Writes the line of an event in the output of STATS.
+/// @param event Event to be described.
+/// @param reserved Number of reserved seats of the event.
+/// @param dst Buffer with room for STATS_LINE_MAX characters.
+/// @return Number of characters written.
+static size_t format_stats(struct Event *event, size_t reserved, char *dst) {
+  int len = snprintf(dst, STATS_LINE_MAX, "Event %u: %zu reserved, %zu free\n", event->id,
+                     reserved, event->rows * event->cols - reserved);
+  return (size_t)len;
+}
+
+int ems_stats(unsigned int event_id, int out_fd, pthread_mutex_t *wr_out_mutex) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
   }
 
-  // Mutex lock so that no other thread can write to the output file while it is being written to.
-  safe_mutex_lock(wr_out_mutex);
-  if (write_to_out(out_fd, buffer) != 0) {
-    safe_mutex_unlock(wr_out_mutex);
-    free(buffer);
+  struct Event *event = get_event_with_delay(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
-  };
-  safe_mutex_unlock(wr_out_mutex);
+  }
 
-  free(buffer);
+  // The counts are kept up to date by every reservation, so neither the seats nor
+  // their locks are touched. Every row takes at most 20 digits plus a separator.
+  char *buffer = get_scratch(STATS_LINE_MAX + sizeof("Rows:") + event->rows * 21);
+  if (buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for buffer\n");
+    return 1;
+  }
 
-  return 0;
+  size_t reserved = atomic_load_explicit(&event->reserved_seats, memory_order_relaxed);
+  char *cursor = buffer + format_stats(event, reserved, buffer);
+  memcpy(cursor, "Rows:", strlen("Rows:"));
+  cursor += strlen("Rows:");
+  for (size_t i = 0; i < event->rows; i++) {
+    size_t row_reserved = atomic_load_explicit(&event->row_reserved[i], memory_order_relaxed);
+    cursor += snprintf(cursor, 22, " %zu", row_reserved);
+  }
+  *cursor++ = '\n';
+
+  return emit_output(out_fd, wr_out_mutex, buffer, (size_t)(cursor - buffer));
 }
 
 int ems_list_events(int out_fd, pthread_mutex_t *wr_out_mutex) {
@@ -550,66 +1094,66 @@ int ems_list_events(int out_fd, pthread_mutex_t *wr_out_mutex) {
     return 1;
   }
 
-  // Mutex lock so that no other thread can write to the output file while it is being written to.
-  safe_mutex_lock(wr_out_mutex);
-  if (event_list->head == NULL) {
-    if (write_to_out(out_fd, "No events\n") != 0) {
-      safe_mutex_unlock(wr_out_mutex);
-      return 1;
-    }
-
-    safe_mutex_unlock(wr_out_mutex);
-    return 0;
+  struct EventList *list = current_list();
+  size_t num_events = list_size(list);
+  if (num_events == 0) {
+    return emit_output(out_fd, wr_out_mutex, "No events\n", strlen("No events\n"));
   }
-  safe_mutex_unlock(wr_out_mutex);
 
-  char *buffer = (char*) malloc(1);
+  // Every line takes at most the prefix, UINT_DIGITS digits and a newline.
+  char *buffer = get_scratch(num_events * (sizeof(EVENT_PREFIX) - 1 + UINT_DIGITS + 1));
   if (buffer == NULL) {
     fprintf(stderr, "Error allocating memory for buffer\n");
     return 1;
   }
 
-  // Write lock so that no other thread can write to the output file while it is being written to.
-  // In this case, it is not efficient to copy the output to a buffer before writing to the output 
-  // file because the number of events is not known beforehand.
-  safe_mutex_lock(wr_out_mutex);
-  struct ListNode *current = event_list->head;
-  while (current != NULL) {
-    buffer = realloc_and_copy(buffer, sizeof("Event: "), "Event: ");
-    if (buffer == NULL) {
-      safe_mutex_unlock(wr_out_mutex);
-      free(buffer);
-      return 1;
-    }
-    
-    if (write_to_out(out_fd, buffer) != 0) {
-      safe_mutex_unlock(wr_out_mutex);
-      free(buffer);
-      return 1;
-    }
+  // The whole list is rendered before locking the output file, so that other threads
+  // only wait for a single write.
+  char *cursor = buffer;
+  for (size_t i = 0; i < num_events; i++) {
+    memcpy(cursor, EVENT_PREFIX, sizeof(EVENT_PREFIX) - 1);
+    cursor += sizeof(EVENT_PREFIX) - 1;
+    cursor += utoa(list_at(list, i)->id, cursor);
+    *cursor++ = '\n';
+  }
 
-    char event_id_as_char[sizeof(MAX_UINT) + 2];  // max size of uint + \n + \0
-    sprintf(event_id_as_char, "%u\n", current->event->id);
-    buffer = realloc_and_copy(buffer, strlen(event_id_as_char) + 1, event_id_as_char);
-    if (buffer == NULL) {
-      safe_mutex_unlock(wr_out_mutex);
-      free(buffer);
-      return 1;
-    }
+  return emit_output(out_fd, wr_out_mutex, buffer, (size_t)(cursor - buffer));
+}
 
-    if (write_to_out(out_fd, buffer) != 0) {
-      safe_mutex_unlock(wr_out_mutex);
-      free(buffer);
-      return 1;
-    }
+int ems_stats_all(int out_fd, pthread_mutex_t *wr_out_mutex) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
 
-    current = current->next;
+  struct EventList *list = current_list();
+  size_t num_events = list_size(list);
+  if (num_events == 0) {
+    return emit_output(out_fd, wr_out_mutex, "No events\n", strlen("No events\n"));
+  }
+
+  char *buffer = get_scratch((num_events + 1) * STATS_LINE_MAX);
+  if (buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for buffer\n");
+    return 1;
   }
-  safe_mutex_unlock(wr_out_mutex);
 
-  free(buffer);
+  char *cursor = buffer;
+  size_t total_reserved = 0, total_seats = 0;
+  for (size_t i = 0; i < num_events; i++) {
+    struct Event *event = list_at(list, i);
+    size_t reserved = atomic_load_explicit(&event->reserved_seats, memory_order_relaxed);
+    total_reserved += reserved;
+    total_seats += event->rows * event->cols;
+    cursor += format_stats(event, reserved, cursor);
+  }
 
-  return 0;
+  // The total adds up the counts that were printed, so it matches the lines above
+  // even if reservations ran meanwhile.
+  cursor += snprintf(cursor, STATS_LINE_MAX, "Total: %zu reserved, %zu free\n", total_reserved,
+                     total_seats - total_reserved);
+
+  return emit_output(out_fd, wr_out_mutex, buffer, (size_t)(cursor - buffer));
 }
 
 void ems_wait(unsigned int delay_ms) {
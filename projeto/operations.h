@@ -1,19 +1,41 @@
 #ifndef EMS_OPERATIONS_H
 #define EMS_OPERATIONS_H
 
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <pthread.h>
 
+#include "eventlist.h"
+#include "jobsmap.h"
+#include "parser.h"
+#include "reader.h"
+#include "seatlock.h"
+
+/// Growable buffer that receives the output of a thread instead of the .out file.
+struct OutBuffer {
+  char *data;
+  size_t len;
+  size_t capacity;
+};
+
+struct Metrics;
+struct Partition;
+struct Shards;
+
 struct thread_args {
   int id;
   int MAX_THREADS;
-  int jobs_fd;
+  struct Reader *jobs;
+  struct JobsMap *jobs_map; /// Mapped .jobs file, NULL if it is read through jobs.
   int out_fd;
-  unsigned int *delays;
+  atomic_uint *delays; /// Pending WAIT delay of each thread.
   pthread_mutex_t *rd_jobs_mutex;
   pthread_mutex_t *wr_out_mutex;
-  pthread_mutex_t *reservation;
-  pthread_rwlock_t *rwlock_events;
+  pthread_barrier_t *segment_barrier; /// Barrier shared by the threads of the .jobs file.
+  struct Partition *partition; /// Split of the segments between the threads, NULL if unused.
+  struct Shards *shards;       /// Routing of the commands by event, NULL if unused.
+  struct Metrics *metrics;     /// Metrics of the .jobs file, NULL if they are disabled.
 };
 
 /// Creates a malloc with error checking.
@@ -21,15 +43,34 @@ struct thread_args {
 /// @return the pointer of the malloc
 void *safe_malloc(size_t size);
 
-/// Main function of the threads.
+/// Main function of the threads. Runs until the end of the .jobs file, waiting
+/// for the other threads at each BARRIER.
 /// @param args Arguments of the thread.
-/// @return 1 if the thread finds and BARRIER or an EOF, 0 otherwise.
+/// @return NULL.
 void *thread_func(void *args);
 
+/// Runs the WAIT delay pending for the thread, if any.
+/// @param thread_args Arguments of the thread.
+void wait_pending_delay(struct thread_args *thread_args);
+
+/// Reads and runs the next command of a .jobs file. BARRIER and the end of the
+/// commands are only read; handling them is up to the caller.
+/// @param thread_args Arguments of the thread running the command.
+/// @param reader Reader positioned at the command.
+/// @param rd_jobs_mutex Mutex held while reading the command, released as soon as
+/// it is parsed, or NULL if the reader is private to the thread.
+/// @return the command that was read.
+enum Command run_command(struct thread_args *thread_args, struct Reader *reader,
+                         pthread_mutex_t *rd_jobs_mutex);
+
 /// Creates a safe mutex.
 /// @param mutex 
 void safe_mutex_init(pthread_mutex_t *mutex);
 
+/// Creates a safe mutex that can be shared between processes.
+/// @param mutex Mutex in shared memory.
+void safe_mutex_init_shared(pthread_mutex_t *mutex);
+
 /// Safe mutex lock.
 /// @param mutex 
 void safe_mutex_lock(pthread_mutex_t *mutex);
@@ -46,6 +87,10 @@ void safe_mutex_destroy(pthread_mutex_t *mutex);
 /// @param rwl
 void safe_rwlock_init(pthread_rwlock_t *rwl);
 
+/// Creates a safe rwlock that can be shared between processes.
+/// @param rwl RWLock in shared memory.
+void safe_rwlock_init_shared(pthread_rwlock_t *rwl);
+
 /// Safe rwlock wrlock.
 /// @param rwl 
 void safe_rwlock_wrlock(pthread_rwlock_t *rwl);
@@ -62,57 +107,123 @@ void safe_rwlock_unlock(pthread_rwlock_t *rwl);
 /// @param rwl 
 void safe_rwlock_destroy(pthread_rwlock_t *rwl);
 
+/// Creates a safe barrier.
+/// @param barrier
+/// @param count Number of threads that must wait on the barrier.
+void safe_barrier_init(pthread_barrier_t *barrier, unsigned int count);
+
+/// Safe barrier wait.
+/// @param barrier
+/// @return 1 for exactly one of the threads, 0 for the others.
+int safe_barrier_wait(pthread_barrier_t *barrier);
+
+/// Destroys safely a barrier.
+/// @param barrier
+void safe_barrier_destroy(pthread_barrier_t *barrier);
+
+/// Creates a safe condition variable.
+/// @param cond
+void safe_cond_init(pthread_cond_t *cond);
+
+/// Creates a safe condition variable that can be shared between processes.
+/// @param cond Condition variable in shared memory.
+void safe_cond_init_shared(pthread_cond_t *cond);
+
+/// Safe condition variable wait.
+/// @param cond
+/// @param mutex Mutex held by the caller, released while waiting.
+void safe_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+
+/// Safe condition variable broadcast.
+/// @param cond
+void safe_cond_broadcast(pthread_cond_t *cond);
+
+/// Destroys safely a condition variable.
+/// @param cond
+void safe_cond_destroy(pthread_cond_t *cond);
+
+/// Writes a number of bytes to the .out file.
+/// @param out_fd File descriptor of the .out file.
+/// @param buffer Bytes to be written.
+/// @param len Number of bytes.
+/// @return 0 if the bytes were written successfully, 1 otherwise.
+int write_all(int out_fd, const char *buffer, size_t len);
+
+/// Appends bytes to an output buffer, growing it as needed.
+/// @param buffer Buffer to be appended to.
+/// @param bytes Bytes to be appended.
+/// @param len Number of bytes.
+/// @return 0 if the bytes were appended successfully, 1 otherwise.
+int outbuffer_append(struct OutBuffer *buffer, const char *bytes, size_t len);
+
+/// Sorts seat indexes in increasing order and drops the duplicates.
+/// @note Short lists are insertion sorted. Longer ones are radix sorted one byte
+/// at a time, with only as many passes as the largest index of the event needs.
+/// @param seats Indexes of the seats, all below num_event_seats.
+/// @param tmp Array of num_seats entries used by the sort.
+/// @param num_seats Number of seats.
+/// @param num_event_seats Number of seats of the event.
+/// @return Number of distinct seats, which are left at the start of seats.
+size_t sort_seats(size_t *seats, size_t *tmp, size_t num_seats, size_t num_event_seats);
+
 /// Writes the buffer to the .out file.
 /// @param out_fd File descriptor of the .out file.
 /// @param buffer Buffer to be copied to the file.
 /// @return 0 if the buffer was written successfully, 1 otherwise.
 int write_to_out(int out_fd, char *buffer);
 
-/// Reallocates the buffer to the given size and copies the string.
-/// @param buffer Buffer to be reallocated.
-/// @param size Size of the new buffer.
-/// @param str String to be copied to the new buffer.
-/// @return the new buffer
-char* realloc_and_copy(char *buffer, size_t size, const char *str);
-
-/// Compares two seats.
-/// @param a First seat.
-/// @param b Second seat.
-/// @return an integer representing the relative order between the seats.
-int compareSeats(const void *a, const void *b);
-
-/// Sorts the given seats in a defined order.
-/// @param xs Array of rows of the seats to sort.
-/// @param ys Array of columns of the seats to sort.
-/// @param num_seats Number of seats to sort.
-void sortReserve(size_t *xs, size_t *ys, size_t num_seats);
-
 /// Initializes the EMS state.
 /// @param delay_ms State access delay in milliseconds.
+/// @param mode Granularity of the locks that protect the seats of each event.
+/// @param shared 1 to keep the state in shared memory, so that processes forked
+/// afterwards all work on the same events, 0 for a private state per process.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
-int ems_init(unsigned int delay_ms);
+int ems_init(unsigned int delay_ms, enum LockMode mode, int shared);
 
 /// Destroys the EMS state.
 int ems_terminate();
 
+/// Creates a private EMS state, separate from the one of ems_init.
+/// @note ems_init must still be called first, it sets the delay and the lock mode.
+/// @return the new state, NULL if it could not be created.
+struct EventList *ems_state_create();
+
+/// Destroys a state created by ems_state_create.
+/// @param state State to be destroyed, no thread may still be attached to it.
+void ems_state_destroy(struct EventList *state);
+
+/// Makes the calling thread work on the given state instead of the one of ems_init.
+/// @param state State to be used by the thread, NULL for the one of ems_init.
+void ems_state_attach(struct EventList *state);
+
+/// Sends the output of the calling thread to a buffer instead of the .out file.
+/// @param buffer Buffer that receives the output, NULL to write to the .out file.
+void ems_capture_output(struct OutBuffer *buffer);
+
 /// Creates a new event with the given id and dimensions.
 /// @param event_id Id of the event to be created.
 /// @param num_rows Number of rows of the event to be created.
 /// @param num_cols Number of columns of the event to be created.
-/// @param rwlock_events RWLock to be used to access the events list.
 /// @return 0 if the event was created successfully, 1 otherwise.
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols,
-               pthread_rwlock_t *rwlock_events);
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 
 /// Creates a new reservation for the given event.
+/// @note A seat listed more than once is reserved once.
 /// @param event_id Id of the event to create a reservation for.
 /// @param num_seats Number of seats to reserve.
 /// @param xs Array of rows of the seats to reserve.
 /// @param ys Array of columns of the seats to reserve.
-/// @param reservation Mutex to be used to access the reservation variable.
 /// @return 0 if the reservation was created successfully, 1 otherwise.
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys,
-                pthread_mutex_t *reservation);
+int ems_reserve(unsigned int event_id, size_t num_seats, const uint32_t *xs, const uint32_t *ys);
+
+/// Reserves consecutive seats of the given event, wherever they are free.
+/// @note The seats are looked for in the occupancy bitmap of the event, from the
+/// hinted row outwards, and then reserved like with ems_reserve.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve, all in the same row.
+/// @param row_hint Row to look in first, from 1, or 0 for no preference.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_best(unsigned int event_id, size_t num_seats, size_t row_hint);
 
 /// Prints the given event.
 /// @param event_id Id of the event to print.
@@ -125,6 +236,19 @@ int ems_show(unsigned int event_id, int out_fd, pthread_mutex_t *wr_out_mutex);
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(int out_fd, pthread_mutex_t *wr_out_mutex);
 
+/// Prints how many seats of an event are reserved and free, and how many are
+/// reserved in each row.
+/// @note The counts are kept by the reservations, so the seats are not read.
+/// @param event_id Id of the event.
+/// @param wr_out_mutex Mutex to be used to write to the output file.
+/// @return 0 if the stats were printed successfully, 1 otherwise.
+int ems_stats(unsigned int event_id, int out_fd, pthread_mutex_t *wr_out_mutex);
+
+/// Prints how many seats of every event are reserved and free, and the totals.
+/// @param wr_out_mutex Mutex to be used to write to the output file.
+/// @return 0 if the stats were printed successfully, 1 otherwise.
+int ems_stats_all(int out_fd, pthread_mutex_t *wr_out_mutex);
+
 /// Waits for a given amount of time.
 /// @param delay_us Delay in milliseconds.
 void ems_wait(unsigned int delay_ms);
@@ -3,34 +3,42 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 #include <stdio.h>
 
 #include "constants.h"
+#include "reader.h"
+#include "scan.h"
 
-static int read_uint(int fd, unsigned int *value, char *next) {
+static int read_uint(struct Reader *reader, unsigned int *value, char *next) {
   char buf[16];
 
-  int i = 0;
+  size_t i = 0;
+  int overflow = 0;
   while (1) {
-    if (read(fd, buf + i, 1) == 0) {
+    int ch = reader_getc(reader);
+    if (ch == READER_EOF) {
       *next = '\0';
       break;
     }
 
-    *next = buf[i];
+    *next = (char)ch;
 
-    if (buf[i] > '9' || buf[i] < '0') {
-      buf[i] = '\0';
+    if (ch > '9' || ch < '0') {
       break;
     }
 
-    i++;
+    // Digits that do not fit in the buffer can only make the value too large.
+    if (i < sizeof(buf) - 1) {
+      buf[i++] = (char)ch;
+    } else {
+      overflow = 1;
+    }
   }
+  buf[i] = '\0';
 
   unsigned long ul = strtoul(buf, NULL, 10);
 
-  if (ul > UINT_MAX) {
+  if (overflow || ul > UINT_MAX) {
     return 1;
   }
 
@@ -39,128 +47,171 @@ static int read_uint(int fd, unsigned int *value, char *next) {
   return 0;
 }
 
-void cleanup(int fd) {
-  char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
+/// Consumes the given keyword.
+/// @note On a mismatch, the mismatching byte is not consumed.
+/// @param reader Reader to read from.
+/// @param keyword Keyword to be matched.
+/// @return 0 if the keyword was matched, 1 otherwise.
+static int match(struct Reader *reader, const char *keyword) {
+  for (; *keyword != '\0'; keyword++) {
+    int ch = reader_getc(reader);
+    if (ch != (unsigned char)*keyword) {
+      if (ch != READER_EOF) {
+        reader_unread(reader, 1);
+      }
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/// Consumes the end of a line.
+/// @param reader Reader to read from.
+/// @return 0 if the line ended, 1 otherwise.
+static int match_eol(struct Reader *reader) {
+  int ch = reader_getc(reader);
+  return ch != '\n' && ch != READER_EOF;
+}
+
+void cleanup(struct Reader *reader) {
+  int ch;
+  while ((ch = reader_getc(reader)) != READER_EOF && ch != '\n')
     ;
 }
 
-enum Command get_next(int fd) {
-  char buf[16];
-  if (read(fd, buf, 1) != 1) {
-    return EOC;
+/// Consumes the rest of a line that failed to parse.
+/// @note Stops at a newline that made the line fail, as a mapped line would, so
+/// that the next command is never swallowed.
+/// @param reader Reader to read from.
+/// @param last Last byte consumed, which already ended the line if it was a newline.
+static void skip_line(struct Reader *reader, int last) {
+  if (last != '\n') {
+    cleanup(reader);
   }
+}
+
+enum Command get_next(struct Reader *reader) {
+  switch (reader_getc(reader)) {
+  case READER_EOF:
+    return EOC;
 
-  switch (buf[0]) {
   case 'C':
-    if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
-      cleanup(fd);
+    if (match(reader, "REATE ") != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_CREATE;
 
   case 'R':
-    if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
-      cleanup(fd);
+    if (match(reader, "ESERVE") != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    return CMD_RESERVE;
+    if (match(reader, " ") == 0) {
+      return CMD_RESERVE;
+    }
 
-  case 'S':
-    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
-      cleanup(fd);
+    if (match(reader, "_BEST ") != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    return CMD_SHOW;
+    return CMD_RESERVE_BEST;
 
-  case 'L':
-    if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
-      cleanup(fd);
+  case 'S':
+    if (reader_peek(reader) == 'T') {
+      if (match(reader, "TATS") != 0) {
+        cleanup(reader);
+        return CMD_INVALID;
+      }
+
+      return CMD_STATS;
+    }
+
+    if (match(reader, "HOW ") != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-      cleanup(fd);
+    return CMD_SHOW;
+
+  case 'L':
+    if (match(reader, "IST") != 0 || match_eol(reader) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_LIST_EVENTS;
 
   case 'B':
-    if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
-      cleanup(fd);
+    if (match(reader, "ARRIER") != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    if (read(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
-      cleanup(fd);
+    if (reader_peek(reader) == READER_EOF) {
+      // Gives the command back so that the barrier will be read by the other threads.
+      reader_unread(reader, 7);
+    } else if (match_eol(reader) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
-    }
-
-    // Sets the cursor back 8 bytes so that the barrier command will be read by the other threads.
-    if (lseek(fd, -8, SEEK_CUR) == -1) {
-      fprintf(stderr, "lseek failed\n");
-      return 1;
+    } else {
+      reader_unread(reader, 8);
     }
 
     return CMD_BARRIER;
 
   case 'W':
-    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-      cleanup(fd);
+    if (match(reader, "AIT ") != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_WAIT;
 
   case 'H':
-    if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
-      cleanup(fd);
-      return CMD_INVALID;
-    }
-
-    if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-      cleanup(fd);
+    if (match(reader, "ELP") != 0 || match_eol(reader) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_HELP;
 
   case '#':
-    cleanup(fd);
+    cleanup(reader);
     return CMD_EMPTY;
 
   case '\n':
     return CMD_EMPTY;
 
   default:
-    cleanup(fd);
+    cleanup(reader);
     return CMD_INVALID;
   }
 }
 
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows,
-                 size_t *num_cols) {
+int parse_create(struct Reader *reader, unsigned int *event_id,
+                 size_t *num_rows, size_t *num_cols) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    skip_line(reader, ch);
     return 1;
   }
 
   unsigned int u_num_rows;
-  if (read_uint(fd, &u_num_rows, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, &u_num_rows, &ch) != 0 || ch != ' ') {
+    skip_line(reader, ch);
     return 1;
   }
   *num_rows = (size_t)u_num_rows;
 
   unsigned int u_num_cols;
-  if (read_uint(fd, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_uint(reader, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    skip_line(reader, ch);
     return 1;
   }
   *num_cols = (size_t)u_num_cols;
@@ -168,93 +219,216 @@ int parse_create(int fd, unsigned int *event_id, size_t *num_rows,
   return 0;
 }
 
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs,
-                     size_t *ys) {
+int coords_reserve(struct Coords *coords, size_t count) {
+  if (count <= coords->capacity) {
+    return 0;
+  }
+
+  size_t capacity = coords->capacity > 0 ? coords->capacity : 256;
+  while (capacity < count) {
+    capacity *= 2;
+  }
+
+  uint32_t *xs = (uint32_t *)realloc(coords->xs, capacity * sizeof(uint32_t));
+  if (xs == NULL) {
+    return 1;
+  }
+  coords->xs = xs;
+
+  uint32_t *ys = (uint32_t *)realloc(coords->ys, capacity * sizeof(uint32_t));
+  if (ys == NULL) {
+    return 1;
+  }
+  coords->ys = ys;
+
+  coords->capacity = capacity;
+  return 0;
+}
+
+void coords_destroy(struct Coords *coords) {
+  free(coords->xs);
+  free(coords->ys);
+  coords->xs = NULL;
+  coords->ys = NULL;
+  coords->capacity = 0;
+}
+
+size_t parse_reserve(struct Reader *reader, unsigned int *event_id, struct Coords *coords) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    skip_line(reader, ch);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
+  int next = reader_getc(reader);
+  if (next != '[') {
+    skip_line(reader, next);
     return 0;
   }
 
+  if (RESERVE_FAST_SCAN && reader->pos < reader->len) {
+    size_t consumed;
+    size_t num_coords =
+        scan_coords(reader->buf + reader->pos, reader->len - reader->pos, coords, &consumed);
+    if (num_coords != 0) {
+      reader->pos += consumed;
+      if (match_eol(reader) != 0) {
+        cleanup(reader);
+        return 0;
+      }
+      return num_coords;
+    }
+  }
+
   size_t num_coords = 0;
-  while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
-      cleanup(fd);
+  while (1) {
+    next = reader_getc(reader);
+    if (next != '(') {
+      skip_line(reader, next);
+      return 0;
+    }
+
+    if (coords_reserve(coords, num_coords + 1) != 0) {
+      fprintf(stderr, "Error allocating memory for coordinates\n");
+      cleanup(reader);
       return 0;
     }
 
     unsigned int x;
-    if (read_uint(fd, &x, &ch) != 0 || ch != ',') {
-      cleanup(fd);
+    if (read_uint(reader, &x, &ch) != 0 || ch != ',') {
+      skip_line(reader, ch);
       return 0;
     }
-    xs[num_coords] = (size_t)x;
+    coords->xs[num_coords] = x;
 
     unsigned int y;
-    if (read_uint(fd, &y, &ch) != 0 || ch != ')') {
-      cleanup(fd);
+    if (read_uint(reader, &y, &ch) != 0 || ch != ')') {
+      skip_line(reader, ch);
       return 0;
     }
-    ys[num_coords] = (size_t)y;
+    coords->ys[num_coords] = y;
 
     num_coords++;
 
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
-      cleanup(fd);
+    next = reader_getc(reader);
+    if (next != ' ' && next != ']') {
+      skip_line(reader, next);
       return 0;
     }
 
-    if (ch == ']') {
+    if (next == ']') {
       break;
     }
   }
 
-  if (num_coords == max) {
-    cleanup(fd);
+  if (match_eol(reader) != 0) {
+    cleanup(reader);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
-    return 0;
+  return num_coords;
+}
+
+int parse_reserve_best(struct Reader *reader, unsigned int *event_id, size_t *num_seats,
+                       size_t *row_hint) {
+  char ch;
+
+  if (read_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    skip_line(reader, ch);
+    return 1;
   }
 
-  return num_coords;
+  unsigned int u_num_seats;
+  if (read_uint(reader, &u_num_seats, &ch) != 0 || u_num_seats == 0) {
+    skip_line(reader, ch);
+    return 1;
+  }
+  *num_seats = (size_t)u_num_seats;
+  *row_hint = 0;
+
+  if (ch == ' ') {
+    unsigned int u_row_hint;
+    if (read_uint(reader, &u_row_hint, &ch) != 0) {
+      skip_line(reader, ch);
+      return 1;
+    }
+    *row_hint = (size_t)u_row_hint;
+  }
+
+  if (ch != '\n' && ch != '\0') {
+    cleanup(reader);
+    return 1;
+  }
+
+  return 0;
 }
 
-int parse_show(int fd, unsigned int *event_id) {
+int parse_show(struct Reader *reader, unsigned int *event_id) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    skip_line(reader, ch);
     return 1;
   }
 
   return 0;
 }
 
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
+int parse_stats(struct Reader *reader, unsigned int *event_id) {
+  char ch;
+
+  int next = reader_getc(reader);
+  if (next == '\n' || next == READER_EOF) {
+    return 0;
+  }
+
+  if (next != ' ') {
+    cleanup(reader);
+    return -1;
+  }
+
+  if (read_uint(reader, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    skip_line(reader, ch);
+    return -1;
+  }
+
+  return 1;
+}
+
+enum Command peek_command(struct Reader *reader, unsigned int *event_id, int *has_event) {
+  char ch;
+  enum Command command = get_next(reader);
+
+  if (command == CMD_STATS) {
+    *has_event = reader_getc(reader) == ' ' && read_uint(reader, event_id, &ch) == 0;
+    return command;
+  }
+
+  *has_event = (command == CMD_CREATE || command == CMD_RESERVE ||
+                command == CMD_RESERVE_BEST || command == CMD_SHOW) &&
+               read_uint(reader, event_id, &ch) == 0;
+
+  return command;
+}
+
+int parse_wait(struct Reader *reader, unsigned int *delay,
+               unsigned int *thread_id) {
   char ch;
 
-  if (read_uint(fd, delay, &ch) != 0) {
-    cleanup(fd);
+  if (read_uint(reader, delay, &ch) != 0) {
+    skip_line(reader, ch);
     return -1;
   }
 
   if (ch == ' ') {
     if (thread_id == NULL) {
-      cleanup(fd);
+      cleanup(reader);
       return 0;
     }
 
-    if (read_uint(fd, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-      cleanup(fd);
+    if (read_uint(reader, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+      skip_line(reader, ch);
       return -1;
     }
 
@@ -262,7 +436,18 @@ int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   } else if (ch == '\n' || ch == '\0') {
     return 0;
   } else {
-    cleanup(fd);
+    cleanup(reader);
     return -1;
   }
 }
+
+const struct JobsDecoder text_decoder = {
+    .get_next = get_next,
+    .peek_command = peek_command,
+    .parse_create = parse_create,
+    .parse_reserve = parse_reserve,
+    .parse_reserve_best = parse_reserve_best,
+    .parse_show = parse_show,
+    .parse_stats = parse_stats,
+    .parse_wait = parse_wait,
+};
@@ -2,13 +2,18 @@
 #define EMS_PARSER_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <pthread.h>
 
+#include "reader.h"
+
 enum Command {
   CMD_CREATE,
   CMD_RESERVE,
+  CMD_RESERVE_BEST,
   CMD_SHOW,
   CMD_LIST_EVENTS,
+  CMD_STATS,
   CMD_BARRIER,
   CMD_WAIT,
   CMD_HELP,
@@ -17,48 +22,112 @@ enum Command {
   EOC // End of commands
 };
 
+/// Growable arrays of the coordinates of a RESERVE command. Coordinates are
+/// unsigned ints in the .jobs files, so they are kept in 32 bits.
+struct Coords {
+  uint32_t *xs;    /// Rows of the seats.
+  uint32_t *ys;    /// Columns of the seats.
+  size_t capacity; /// Number of entries of each array.
+};
+
+/// Grows the coordinate arrays to hold at least count entries.
+/// @note Existing entries are kept.
+/// @param coords Coordinates to be grown.
+/// @param count Number of entries needed.
+/// @return 0 if the arrays hold count entries, 1 on allocation failure.
+int coords_reserve(struct Coords *coords, size_t count);
+
+/// Frees the coordinate arrays.
+/// @param coords Coordinates to be freed.
+void coords_destroy(struct Coords *coords);
+
 /// Reads a line and returns the corresponding command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @return The command read.
-enum Command get_next(int fd);
+enum Command get_next(struct Reader *reader);
 
 /// Parses a CREATE command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @param num_rows Pointer to the variable to store the number of rows in.
 /// @param num_cols Pointer to the variable to store the number of columns in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows,
-                 size_t *num_cols);
+int parse_create(struct Reader *reader, unsigned int *event_id,
+                 size_t *num_rows, size_t *num_cols);
 
 /// Parses a RESERVE command.
-/// @param fd File descriptor to read from.
-/// @param max Maximum number of coordinates to read.
+/// @param reader Reader to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
-/// @param xs Pointer to the array to store the X coordinates in.
-/// @param ys Pointer to the array to store the Y coordinates in.
+/// @param coords Coordinates to store the seats in, grown as needed.
 /// @return Number of coordinates read. 0 on failure.
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs,
-                     size_t *ys);
+size_t parse_reserve(struct Reader *reader, unsigned int *event_id, struct Coords *coords);
+
+/// Parses a RESERVE_BEST command.
+/// @param reader Reader to read from.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @param num_seats Pointer to the variable to store the number of seats in.
+/// @param row_hint Pointer to the variable to store the hinted row in, 0 if
+/// there is none.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_reserve_best(struct Reader *reader, unsigned int *event_id, size_t *num_seats,
+                       size_t *row_hint);
 
 /// Parses a SHOW command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
-int parse_show(int fd, unsigned int *event_id);
+int parse_show(struct Reader *reader, unsigned int *event_id);
+
+/// Parses a STATS command.
+/// @param reader Reader to read from.
+/// @param event_id Pointer to the variable to store the event ID in. Only set
+/// if an event was specified.
+/// @return 0 if no event was specified, 1 if an event was specified, -1 on
+/// error.
+int parse_stats(struct Reader *reader, unsigned int *event_id);
+
+/// Reads a command and, for CREATE, RESERVE, RESERVE_BEST, SHOW and STATS of
+/// a single event, the ID of its event.
+/// @note Only the keyword and the ID are consumed, the command must still be
+/// parsed in full to be run.
+/// @param reader Reader to read from.
+/// @param event_id Pointer to the variable to store the event ID in. Only set
+/// for commands on an event.
+/// @param has_event Set to 1 if an event ID was read, 0 otherwise.
+/// @return The command read.
+enum Command peek_command(struct Reader *reader, unsigned int *event_id, int *has_event);
 
 /// Parses a WAIT command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
 /// @param thread_id Pointer to the variable to store the thread ID in. May not
 /// be set.
 /// @return 0 if no thread was specified, 1 if a thread was specified, -1 on
 /// error.
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id);
+int parse_wait(struct Reader *reader, unsigned int *delay,
+               unsigned int *thread_id);
 
 
-/// Cleans
-/// @param fd 
-void cleanup(int fd);
+/// Consumes the rest of the current line.
+/// @param reader Reader to read from.
+void cleanup(struct Reader *reader);
+
+/// Functions that read the commands of a .jobs file in one of its formats. They
+/// all behave like the text parser functions of the same name.
+struct JobsDecoder {
+  enum Command (*get_next)(struct Reader *reader);
+  enum Command (*peek_command)(struct Reader *reader, unsigned int *event_id, int *has_event);
+  int (*parse_create)(struct Reader *reader, unsigned int *event_id, size_t *num_rows,
+                      size_t *num_cols);
+  size_t (*parse_reserve)(struct Reader *reader, unsigned int *event_id, struct Coords *coords);
+  int (*parse_reserve_best)(struct Reader *reader, unsigned int *event_id, size_t *num_seats,
+                            size_t *row_hint);
+  int (*parse_show)(struct Reader *reader, unsigned int *event_id);
+  int (*parse_stats)(struct Reader *reader, unsigned int *event_id);
+  int (*parse_wait)(struct Reader *reader, unsigned int *delay, unsigned int *thread_id);
+};
+
+/// Decoder of text .jobs files.
+extern const struct JobsDecoder text_decoder;
 
 #endif // EMS_PARSER_H
@@ -0,0 +1,206 @@
+#include "partition.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "jobsbin.h"
+#include "parser.h"
+#include "reader.h"
+
+/// Finds the thread that runs a line.
+/// @param partition Partition of the file.
+/// @param line Index of the line.
+/// @return Index of the thread, or PARTITION_SYNC if the line runs alone.
+static int line_owner(struct Partition *partition, size_t line) {
+  struct Reader reader;
+  jobsmap_line(partition->map, line, &reader);
+
+  unsigned int event_id;
+  int has_event;
+  const struct JobsDecoder *decoder = jobsbin_decoder(partition->map);
+  enum Command command = decoder->peek_command(&reader, &event_id, &has_event);
+
+  if (command == CMD_CREATE || command == CMD_LIST_EVENTS ||
+      (command == CMD_STATS && !has_event)) {
+    return PARTITION_SYNC;
+  }
+
+  if (has_event) {
+    return (int)(event_id % (unsigned int)partition->num_threads);
+  }
+
+  // Commands without an event only need to be spread out.
+  return (int)(line % (size_t)partition->num_threads);
+}
+
+/// Runs a line owned by the calling thread, keeping its output in the thread's
+/// buffer.
+/// @param partition Partition of the file.
+/// @param thread_args Arguments of the calling thread.
+/// @param line Index of the line.
+static void run_owned(struct Partition *partition, struct thread_args *thread_args,
+                      size_t line) {
+  struct OutBuffer *out = &partition->outs[thread_args->id];
+  size_t start = out->len;
+
+  wait_pending_delay(thread_args);
+
+  struct Reader reader;
+  jobsmap_line(partition->map, line, &reader);
+
+  ems_capture_output(out);
+  run_command(thread_args, &reader, NULL);
+  ems_capture_output(NULL);
+
+  partition->out_starts[line] = start;
+  partition->out_lens[line] = out->len - start;
+}
+
+/// Writes bytes to the .out file under its lock.
+/// @param thread_args Arguments of the calling thread.
+/// @param bytes Bytes to be written.
+/// @param len Number of bytes.
+static void write_out(struct thread_args *thread_args, const char *bytes, size_t len) {
+  if (len == 0) {
+    return;
+  }
+
+  safe_mutex_lock(thread_args->wr_out_mutex);
+  if (write_all(thread_args->out_fd, bytes, len) != 0) {
+    fprintf(stderr, "Failed to write to .out file\n");
+  }
+  safe_mutex_unlock(thread_args->wr_out_mutex);
+}
+
+/// Writes the output of a round of lines in command order and empties the
+/// buffers of the threads.
+/// @note Must only be called while the other threads wait.
+/// @param partition Partition of the file.
+/// @param thread_args Arguments of the calling thread.
+/// @param from First line of the round.
+/// @param to Line after the last one of the round.
+static void flush_round(struct Partition *partition, struct thread_args *thread_args,
+                        size_t from, size_t to) {
+  struct OutBuffer *merged = &partition->merged;
+  merged->len = 0;
+
+  for (size_t line = from; line < to; line++) {
+    int owner = partition->owners[line];
+    if (owner == PARTITION_SYNC || partition->out_lens[line] == 0) {
+      continue;
+    }
+
+    const char *output = partition->outs[owner].data + partition->out_starts[line];
+    if (outbuffer_append(merged, output, partition->out_lens[line]) != 0) {
+      // Without memory to merge it, the output of the line is written right after
+      // what was merged before it, which keeps the command order.
+      write_out(thread_args, merged->data, merged->len);
+      write_out(thread_args, output, partition->out_lens[line]);
+      merged->len = 0;
+    }
+  }
+
+  for (int i = 0; i < partition->num_threads; i++) {
+    partition->outs[i].len = 0;
+  }
+
+  write_out(thread_args, merged->data, merged->len);
+}
+
+void partition_init(struct Partition *partition, struct JobsMap *map, int num_threads) {
+  size_t num_lines = map->num_lines > 0 ? map->num_lines : 1;
+
+  partition->map = map;
+  partition->num_threads = num_threads;
+  partition->owners = (int *)safe_malloc(num_lines * sizeof(int));
+  partition->out_starts = (size_t *)safe_malloc(num_lines * sizeof(size_t));
+  partition->out_lens = (size_t *)safe_malloc(num_lines * sizeof(size_t));
+
+  partition->outs = (struct OutBuffer *)safe_malloc((size_t)num_threads * sizeof(struct OutBuffer));
+  for (int i = 0; i < num_threads; i++) {
+    partition->outs[i] = (struct OutBuffer){NULL, 0, 0};
+  }
+  partition->merged = (struct OutBuffer){NULL, 0, 0};
+
+  partition->done = 0;
+}
+
+void partition_destroy(struct Partition *partition) {
+  for (int i = 0; i < partition->num_threads; i++) {
+    free(partition->outs[i].data);
+  }
+  free(partition->outs);
+  free(partition->merged.data);
+
+  free(partition->owners);
+  free(partition->out_starts);
+  free(partition->out_lens);
+}
+
+void *partition_thread_func(void *args) {
+  struct thread_args *thread_args = (struct thread_args *)args;
+  struct Partition *partition = thread_args->partition;
+  struct JobsMap *map = partition->map;
+  pthread_barrier_t *barrier = thread_args->segment_barrier;
+  int id = thread_args->id;
+
+  while (1) {
+    size_t begin = map->begin;
+    size_t end = map->end;
+
+    // The threads split the lines of the segment between them, then all wait for the split.
+    for (size_t line = begin + (size_t)id; line < end; line += (size_t)partition->num_threads) {
+      partition->owners[line] = line_owner(partition, line);
+    }
+    safe_barrier_wait(barrier);
+
+    size_t round = begin;
+    size_t line = begin;
+    while (line < end) {
+      int owner = partition->owners[line];
+
+      if (owner == id) {
+        run_owned(partition, thread_args, line);
+        line++;
+      } else if (owner == PARTITION_SYNC) {
+        size_t stop = line;
+        while (stop < end && partition->owners[stop] == PARTITION_SYNC) {
+          stop++;
+        }
+
+        // Once every thread has run its lines of the round, one thread writes their
+        // output and runs the CREATEs, LISTs and STATS alone.
+        if (safe_barrier_wait(barrier)) {
+          flush_round(partition, thread_args, round, line);
+          for (; line < stop; line++) {
+            wait_pending_delay(thread_args);
+
+            struct Reader reader;
+            jobsmap_line(map, line, &reader);
+            run_command(thread_args, &reader, NULL);
+          }
+        }
+        safe_barrier_wait(barrier);
+
+        round = line = stop;
+      } else {
+        line++;
+      }
+    }
+
+    // The BARRIER, or the end of the file, closes the last round.
+    if (safe_barrier_wait(barrier)) {
+      flush_round(partition, thread_args, round, end);
+      partition->done = !jobsmap_at_barrier(map);
+      jobsmap_next_segment(map);
+    }
+    safe_barrier_wait(barrier);
+
+    if (partition->done) {
+      break;
+    }
+  }
+
+  return NULL;
+}
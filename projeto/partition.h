@@ -0,0 +1,51 @@
+#ifndef EMS_PARTITION_H
+#define EMS_PARTITION_H
+
+#include <stddef.h>
+
+#include "jobsmap.h"
+#include "operations.h"
+
+/// Owner of the lines that are run by a single thread while the others wait.
+#define PARTITION_SYNC (-1)
+
+/// Split of the segments of a mapped .jobs file between its threads, so that the
+/// .out file is the same on every run.
+/// @note Commands on an event all go to the thread that owns the event and run in
+/// file order, so their output does not depend on timing. CREATE, LIST and STATS
+/// of every event depend on every event and run alone, after the commands before
+/// them. Each thread keeps its output in a private buffer, and the buffers are
+/// written in command order before every CREATE, LIST, STATS of every event and
+/// BARRIER.
+struct Partition {
+  struct JobsMap *map;
+  int num_threads;
+
+  int *owners;        /// Thread that runs each line, PARTITION_SYNC for lines run alone.
+  size_t *out_starts; /// Offset of the output of each line in the buffer of its thread.
+  size_t *out_lens;   /// Length of the output of each line.
+
+  struct OutBuffer *outs; /// Private output of each thread.
+  struct OutBuffer merged; /// Output of a round, in command order.
+
+  int done; /// Set once the last segment has been run.
+};
+
+/// Prepares the split of a mapped .jobs file.
+/// @param partition Partition to be initialized.
+/// @param map Mapped .jobs file.
+/// @param num_threads Number of threads running the file.
+void partition_init(struct Partition *partition, struct JobsMap *map, int num_threads);
+
+/// Frees the buffers of a partition.
+/// @param partition Partition to be destroyed.
+void partition_destroy(struct Partition *partition);
+
+/// Main function of the threads in partitioned mode. Runs the lines of each
+/// segment owned by the thread, waiting for the other threads at each CREATE,
+/// LIST, STATS of every event and BARRIER.
+/// @param args Arguments of the thread, with a partition.
+/// @return NULL.
+void *partition_thread_func(void *args);
+
+#endif // EMS_PARTITION_H
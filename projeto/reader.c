@@ -0,0 +1,95 @@
+#include "reader.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "constants.h"
+
+int reader_init(struct Reader *reader, int fd) {
+  reader->buf = (char *)malloc(READER_BUFFER_SIZE);
+  if (reader->buf == NULL) {
+    fprintf(stderr, "Error allocating memory for reader\n");
+    return 1;
+  }
+
+  reader->fd = fd;
+  reader->offset = 0;
+  reader->size = READER_BUFFER_SIZE;
+  reader->len = 0;
+  reader->pos = 0;
+  return 0;
+}
+
+void reader_init_mem(struct Reader *reader, char *data, size_t len) {
+  reader->fd = -1;
+  reader->offset = 0;
+  reader->buf = data;
+  reader->size = len;
+  reader->len = len;
+  reader->pos = 0;
+}
+
+void reader_destroy(struct Reader *reader) {
+  if (reader->fd != -1) {
+    free(reader->buf);
+  }
+  reader->buf = NULL;
+  reader->len = 0;
+  reader->pos = 0;
+}
+
+/// Reads the next block of the file into the buffer.
+/// @note The last READER_UNREAD_MAX consumed bytes are kept at the start of
+/// the buffer so that they can still be unread.
+/// @param reader Reader to be refilled.
+/// @return Number of new bytes in the buffer, 0 at the end of the file.
+static size_t refill(struct Reader *reader) {
+  if (reader->fd == -1) {
+    return 0;
+  }
+
+  size_t keep = reader->pos < READER_UNREAD_MAX ? reader->pos : READER_UNREAD_MAX;
+  memmove(reader->buf, reader->buf + reader->pos - keep, keep);
+  reader->pos = keep;
+  reader->len = keep;
+
+  ssize_t numRead;
+  do {
+    numRead = pread(reader->fd, reader->buf + keep, reader->size - keep,
+                    reader->offset);
+  } while (numRead == -1 && errno == EINTR);
+
+  if (numRead <= 0) {
+    if (numRead == -1) {
+      fprintf(stderr, "Failed to read from .jobs file\n");
+    }
+    return 0;
+  }
+
+  reader->offset += numRead;
+  reader->len += (size_t)numRead;
+  return (size_t)numRead;
+}
+
+int reader_getc(struct Reader *reader) {
+  if (reader->pos == reader->len && refill(reader) == 0) {
+    return READER_EOF;
+  }
+
+  return (unsigned char)reader->buf[reader->pos++];
+}
+
+int reader_peek(struct Reader *reader) {
+  if (reader->pos == reader->len && refill(reader) == 0) {
+    return READER_EOF;
+  }
+
+  return (unsigned char)reader->buf[reader->pos];
+}
+
+void reader_unread(struct Reader *reader, size_t count) {
+  reader->pos = count < reader->pos ? reader->pos - count : 0;
+}
@@ -0,0 +1,56 @@
+#ifndef EMS_READER_H
+#define EMS_READER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/// Number of already consumed bytes that a refill keeps in the buffer, so
+/// that they can always be given back with reader_unread.
+#define READER_UNREAD_MAX 16
+
+/// Sentinel returned by reader_getc and reader_peek at the end of the input.
+#define READER_EOF (-1)
+
+struct Reader {
+  int fd;       /// File descriptor being read, -1 for in-memory readers.
+  off_t offset; /// File offset of the next refill.
+
+  char *buf;   /// Buffer with the bytes read from the file.
+  size_t size; /// Capacity of the buffer.
+  size_t len;  /// Number of valid bytes in the buffer.
+  size_t pos;  /// Position of the next byte to be consumed.
+};
+
+/// Initializes a buffered reader over a file.
+/// @param reader Reader to be initialized.
+/// @param fd File descriptor to read from, starting at offset 0.
+/// @return 0 if the reader was initialized successfully, 1 otherwise.
+int reader_init(struct Reader *reader, int fd);
+
+/// Initializes a reader over bytes that are already in memory.
+/// @note The bytes are not copied and must outlive the reader.
+/// @param reader Reader to be initialized.
+/// @param data Bytes to read from.
+/// @param len Number of bytes.
+void reader_init_mem(struct Reader *reader, char *data, size_t len);
+
+/// Frees the buffer of a reader. Does not close the file descriptor.
+/// @param reader Reader to be destroyed.
+void reader_destroy(struct Reader *reader);
+
+/// Consumes the next byte.
+/// @param reader Reader to read from.
+/// @return The byte read, READER_EOF at the end of the input.
+int reader_getc(struct Reader *reader);
+
+/// Returns the next byte without consuming it.
+/// @param reader Reader to read from.
+/// @return The next byte, READER_EOF at the end of the input.
+int reader_peek(struct Reader *reader);
+
+/// Gives back the last consumed bytes, so that they are read again.
+/// @param reader Reader to be modified.
+/// @param count Number of bytes to give back, at most READER_UNREAD_MAX.
+void reader_unread(struct Reader *reader, size_t count);
+
+#endif // EMS_READER_H
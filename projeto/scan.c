@@ -0,0 +1,225 @@
+#include "scan.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_X86 0
+#endif
+
+/// Bytes classified at a time.
+#define SCAN_BLOCK 32
+
+/// Longest digit run that is converted, longer ones are left to the parser.
+#define SCAN_MAX_DIGITS 10
+
+/// Classes of the bytes of a coordinate list.
+enum ByteClass { BYTE_OTHER, BYTE_DIGIT, BYTE_STRUCTURAL };
+
+/// Bit masks of the bytes of a block, bit i for byte i.
+struct BlockMasks {
+  uint32_t digits;     /// Bytes '0' to '9'.
+  uint32_t structural; /// Bytes '(', ',', ')', ' ' and ']'.
+};
+
+static unsigned char byte_class[UCHAR_MAX + 1];
+
+/// Fills byte_class.
+/// @note Called before main, so that threads only ever read the table.
+__attribute__((constructor)) static void scan_init(void) {
+  for (int ch = '0'; ch <= '9'; ch++) {
+    byte_class[ch] = BYTE_DIGIT;
+  }
+  byte_class['('] = BYTE_STRUCTURAL;
+  byte_class[','] = BYTE_STRUCTURAL;
+  byte_class[')'] = BYTE_STRUCTURAL;
+  byte_class[' '] = BYTE_STRUCTURAL;
+  byte_class[']'] = BYTE_STRUCTURAL;
+}
+
+static struct BlockMasks classify_scalar(const char *block) {
+  struct BlockMasks masks = {0, 0};
+  for (unsigned int i = 0; i < SCAN_BLOCK; i++) {
+    switch ((enum ByteClass)byte_class[(unsigned char)block[i]]) {
+    case BYTE_DIGIT:
+      masks.digits |= (uint32_t)1 << i;
+      break;
+    case BYTE_STRUCTURAL:
+      masks.structural |= (uint32_t)1 << i;
+      break;
+    case BYTE_OTHER:
+      break;
+    }
+  }
+  return masks;
+}
+
+#if SCAN_X86
+/// Mask of the bytes of a 16-byte vector that are ASCII digits or structural.
+__attribute__((target("sse2"))) static inline void
+classify_sse2_half(__m128i bytes, uint32_t *digits, uint32_t *structural) {
+  // Bytes below '0' wrap around to large values, so one unsigned compare is enough.
+  __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+  __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset);
+
+  __m128i is_structural = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('(')),
+                   _mm_cmpeq_epi8(bytes, _mm_set1_epi8(','))),
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(')')),
+                                _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '))),
+                   _mm_cmpeq_epi8(bytes, _mm_set1_epi8(']'))));
+
+  *digits = (uint32_t)_mm_movemask_epi8(is_digit);
+  *structural = (uint32_t)_mm_movemask_epi8(is_structural);
+}
+
+__attribute__((target("sse2"))) static struct BlockMasks classify_sse2(const char *block) {
+  uint32_t lo_digits, lo_structural, hi_digits, hi_structural;
+  classify_sse2_half(_mm_loadu_si128((const __m128i *)(const void *)block), &lo_digits,
+                     &lo_structural);
+  classify_sse2_half(_mm_loadu_si128((const __m128i *)(const void *)(block + 16)), &hi_digits,
+                     &hi_structural);
+
+  struct BlockMasks masks = {lo_digits | hi_digits << 16, lo_structural | hi_structural << 16};
+  return masks;
+}
+
+__attribute__((target("avx2"))) static struct BlockMasks classify_avx2(const char *block) {
+  __m256i bytes = _mm256_loadu_si256((const __m256i *)(const void *)block);
+
+  __m256i offset = _mm256_sub_epi8(bytes, _mm256_set1_epi8('0'));
+  __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(9)), offset);
+
+  __m256i is_structural = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('(')),
+                      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(','))),
+      _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(')')),
+                                      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '))),
+                      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(']'))));
+
+  struct BlockMasks masks = {(uint32_t)_mm256_movemask_epi8(is_digit),
+                             (uint32_t)_mm256_movemask_epi8(is_structural)};
+  return masks;
+}
+#endif
+
+/// Classifies the SCAN_BLOCK bytes starting at block.
+static struct BlockMasks classify(const char *block) {
+#if SCAN_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return classify_avx2(block);
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return classify_sse2(block);
+  }
+#endif
+  return classify_scalar(block);
+}
+
+/// Converts a run of digits.
+/// @return 0 if the value fits in an unsigned int, 1 otherwise.
+static int convert(const char *digits, size_t len, uint32_t *value) {
+  uint64_t result = 0;
+  for (size_t i = 0; i < len; i++) {
+    result = result * 10 + (uint64_t)(digits[i] - '0');
+  }
+
+  if (result > UINT_MAX) {
+    return 1;
+  }
+
+  *value = (uint32_t)result;
+  return 0;
+}
+
+/// Position in a coordinate list, named after the byte expected next.
+enum ScanState { EXPECT_OPEN, EXPECT_COMMA, EXPECT_CLOSE, EXPECT_SEPARATOR };
+
+size_t scan_coords(const char *text, size_t len, struct Coords *coords, size_t *consumed) {
+  enum ScanState state = EXPECT_OPEN;
+  size_t run_start = 0;
+  size_t num_coords = 0;
+
+  for (size_t base = 0; base < len; base += SCAN_BLOCK) {
+    struct BlockMasks masks;
+    if (len - base >= SCAN_BLOCK) {
+      masks = classify(text + base);
+    } else {
+      // The padding bytes are neither digits nor structural.
+      char tail[SCAN_BLOCK] = {0};
+      memcpy(tail, text + base, len - base);
+      masks = classify(tail);
+    }
+
+    uint32_t other = ~(masks.digits | masks.structural);
+    uint32_t structural = masks.structural;
+
+    while (structural != 0) {
+      unsigned int bit = (unsigned int)__builtin_ctz(structural);
+      structural &= structural - 1;
+
+      // Every byte before a structural one must be a digit or structural.
+      if ((other & (((uint32_t)1 << bit) - 1)) != 0) {
+        return 0;
+      }
+
+      size_t pos = base + bit;
+      size_t run_len = pos - run_start;
+      char ch = text[pos];
+      run_start = pos + 1;
+
+      switch (state) {
+      case EXPECT_OPEN:
+        if (ch != '(' || run_len != 0) {
+          return 0;
+        }
+        if (num_coords == coords->capacity && coords_reserve(coords, num_coords + 1) != 0) {
+          return 0;
+        }
+        state = EXPECT_COMMA;
+        break;
+
+      case EXPECT_COMMA:
+        if (ch != ',' || run_len == 0 || run_len > SCAN_MAX_DIGITS ||
+            convert(text + pos - run_len, run_len, &coords->xs[num_coords]) != 0) {
+          return 0;
+        }
+        state = EXPECT_CLOSE;
+        break;
+
+      case EXPECT_CLOSE:
+        if (ch != ')' || run_len == 0 || run_len > SCAN_MAX_DIGITS ||
+            convert(text + pos - run_len, run_len, &coords->ys[num_coords]) != 0) {
+          return 0;
+        }
+        num_coords++;
+        state = EXPECT_SEPARATOR;
+        break;
+
+      case EXPECT_SEPARATOR:
+        if (run_len != 0) {
+          return 0;
+        }
+        if (ch == ']') {
+          *consumed = pos + 1;
+          return num_coords;
+        }
+        if (ch != ' ') {
+          return 0;
+        }
+        state = EXPECT_OPEN;
+        break;
+      }
+    }
+
+    if (other != 0) {
+      return 0;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef EMS_SCAN_H
+#define EMS_SCAN_H
+
+#include <stddef.h>
+
+#include "parser.h"
+
+/// Scans the coordinate list of a RESERVE command, from just after its '['
+/// up to and including the closing ']'.
+/// @note The bytes are classified 32 at a time, with AVX2 or SSE2 when the CPU
+/// has them and with a table otherwise, and the digit runs between the
+/// structural bytes are converted whole. Only well-formed lists are accepted:
+/// on anything else, including a list that does not end within len bytes, the
+/// caller should parse the list byte by byte, which also reports the error.
+/// @param text Bytes after the '['.
+/// @param len Number of bytes available.
+/// @param coords Coordinates to store the seats in, grown as needed.
+/// @param consumed Pointer to the variable to store the number of bytes
+/// scanned in, including the ']'.
+/// @return Number of coordinates scanned, 0 if the list was not accepted.
+size_t scan_coords(const char *text, size_t len, struct Coords *coords, size_t *consumed);
+
+#endif // EMS_SCAN_H
@@ -0,0 +1,425 @@
+#include "scheduler.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "constants.h"
+#include "eventlist.h"
+#include "jobsmap.h"
+#include "metrics.h"
+#include "operations.h"
+
+#define DEQUE_INITIAL_CAPACITY 64
+
+/// A .jobs file being run by the scheduler.
+struct JobsFile {
+  struct JobsMap map;
+  int out_fd;
+  atomic_uint *delays; /// Pending WAIT delay of each logical thread.
+  pthread_mutex_t wr_out_mutex;
+  struct EventList *state; /// Events of the file, NULL if the global state is used.
+  atomic_int pending;      /// Units of the current segment that have not finished.
+  struct Metrics *metrics; /// Metrics of the file, NULL if they are disabled.
+};
+
+/// Runs the current segment of a file as one of its logical threads.
+struct WorkUnit {
+  struct JobsFile *file;
+  int slot; /// Logical thread, the thread id used by WAIT.
+};
+
+/// Work units of a worker. The owner pushes and pops at the tail, other workers
+/// steal from the head, so they take the oldest units.
+struct Deque {
+  pthread_mutex_t lock;
+  struct WorkUnit *units;
+  size_t capacity; /// Always a power of two.
+  size_t head;
+  size_t tail;
+};
+
+struct Scheduler {
+  struct Deque *deques; /// One deque per worker.
+  int num_workers;
+  int max_threads;
+  atomic_size_t files_left; /// Files that have not reached their end.
+  atomic_size_t queued;     /// Units pushed to the deques and not yet taken.
+  pthread_mutex_t idle_lock;
+  pthread_cond_t work_ready; /// Broadcast when units are queued or the last file ends.
+};
+
+struct worker_args {
+  struct Scheduler *scheduler;
+  int id;
+};
+
+/// Initializes an empty deque.
+/// @param deque Deque to be initialized.
+static void deque_init(struct Deque *deque) {
+  safe_mutex_init(&deque->lock);
+  deque->capacity = DEQUE_INITIAL_CAPACITY;
+  deque->units = (struct WorkUnit *)safe_malloc(deque->capacity * sizeof(struct WorkUnit));
+  deque->head = 0;
+  deque->tail = 0;
+}
+
+/// Destroys a deque.
+/// @param deque Deque to be destroyed.
+static void deque_destroy(struct Deque *deque) {
+  safe_mutex_destroy(&deque->lock);
+  free(deque->units);
+}
+
+/// Adds a unit at the tail of a deque.
+/// @param deque Deque to be modified.
+/// @param unit Unit to be added.
+static void deque_push(struct Deque *deque, struct WorkUnit unit) {
+  safe_mutex_lock(&deque->lock);
+
+  if (deque->tail - deque->head == deque->capacity) {
+    struct WorkUnit *units =
+        (struct WorkUnit *)safe_malloc(2 * deque->capacity * sizeof(struct WorkUnit));
+    for (size_t i = deque->head; i < deque->tail; i++) {
+      units[i - deque->head] = deque->units[i & (deque->capacity - 1)];
+    }
+    free(deque->units);
+    deque->units = units;
+    deque->tail -= deque->head;
+    deque->head = 0;
+    deque->capacity *= 2;
+  }
+
+  deque->units[deque->tail++ & (deque->capacity - 1)] = unit;
+  safe_mutex_unlock(&deque->lock);
+}
+
+/// Takes a unit from a deque.
+/// @param deque Deque to take the unit from.
+/// @param unit Receives the unit.
+/// @param steal 1 to take the oldest unit, 0 to take the newest one.
+/// @return 1 if a unit was taken, 0 if the deque is empty.
+static int deque_take(struct Deque *deque, struct WorkUnit *unit, int steal) {
+  safe_mutex_lock(&deque->lock);
+
+  if (deque->head == deque->tail) {
+    safe_mutex_unlock(&deque->lock);
+    return 0;
+  }
+
+  if (steal) {
+    *unit = deque->units[deque->head++ & (deque->capacity - 1)];
+  } else {
+    *unit = deque->units[--deque->tail & (deque->capacity - 1)];
+  }
+
+  safe_mutex_unlock(&deque->lock);
+  return 1;
+}
+
+/// Wakes the workers parked in wait_for_work.
+/// @param scheduler Scheduler whose workers are woken.
+static void wake_workers(struct Scheduler *scheduler) {
+  safe_mutex_lock(&scheduler->idle_lock);
+  safe_cond_broadcast(&scheduler->work_ready);
+  safe_mutex_unlock(&scheduler->idle_lock);
+}
+
+/// Parks an idle worker until units are queued or every file has finished.
+/// @param scheduler Scheduler of the worker.
+static void wait_for_work(struct Scheduler *scheduler) {
+  safe_mutex_lock(&scheduler->idle_lock);
+  while (atomic_load(&scheduler->queued) == 0 && atomic_load(&scheduler->files_left) > 0) {
+    safe_cond_wait(&scheduler->work_ready, &scheduler->idle_lock);
+  }
+  safe_mutex_unlock(&scheduler->idle_lock);
+}
+
+/// Queues the units of the current segment of a file.
+/// @param scheduler Scheduler running the file.
+/// @param worker Worker whose deque receives the units.
+/// @param file File whose segment is queued.
+static void push_segment(struct Scheduler *scheduler, int worker, struct JobsFile *file) {
+  atomic_store(&file->pending, scheduler->max_threads);
+
+  // Counted before they are pushed, so that queued never drops below zero.
+  atomic_fetch_add(&scheduler->queued, (size_t)scheduler->max_threads);
+  for (int slot = 0; slot < scheduler->max_threads; slot++) {
+    struct WorkUnit unit = {.file = file, .slot = slot};
+    deque_push(&scheduler->deques[worker], unit);
+  }
+  wake_workers(scheduler);
+}
+
+/// Opens a .jobs file, maps it and creates its .out file.
+/// @param file File to be initialized.
+/// @param dir_path Directory of the file.
+/// @param name Name of the .jobs file.
+/// @param max_threads Number of logical threads of the file.
+/// @return 0 if the file is ready to be run, 1 otherwise.
+static int open_jobs_file(struct JobsFile *file, const char *dir_path, const char *name,
+                          int max_threads) {
+  size_t len_path = strlen(dir_path) + 1 + strlen(name) + 1; // +1 for '/' and +1 for '\0'
+
+  char *jobs_file_path = (char *)safe_malloc(len_path);
+  strcpy(jobs_file_path, dir_path);
+  strcat(jobs_file_path, "/");
+  strcat(jobs_file_path, name);
+
+  int jobs_fd = open(jobs_file_path, O_RDONLY);
+
+  if (jobs_fd == -1) {
+    fprintf(stderr, "Failed to open .jobs file\n");
+    free(jobs_file_path);
+    return 1;
+  }
+
+  // The mapping outlives the file descriptor.
+  int mapped = jobsmap_init(&file->map, jobs_fd);
+  close(jobs_fd);
+
+  if (mapped != 0) {
+    fprintf(stderr, "Failed to map .jobs file\n");
+    free(jobs_file_path);
+    return 1;
+  }
+
+  file->metrics = NULL;
+  if (EMS_METRICS && (file->metrics = metrics_create(jobs_file_path)) == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    free(jobs_file_path);
+    jobsmap_destroy(&file->map);
+    return 1;
+  }
+
+  int openFlags = O_WRONLY | O_CREAT | O_TRUNC;
+  mode_t filePerms = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+
+  char *out_file_path = (char *)safe_malloc(len_path);
+  memset(out_file_path, 0, len_path);
+  strncpy(out_file_path, jobs_file_path, (size_t)(strrchr(jobs_file_path, '.') - jobs_file_path));
+  strcat(out_file_path, ".out");
+
+  file->out_fd = open(out_file_path, openFlags, filePerms);
+  free(jobs_file_path);
+  free(out_file_path);
+
+  if (file->out_fd == -1) {
+    fprintf(stderr, "Failed to open .out file\n");
+    if (file->metrics != NULL) {
+      metrics_destroy(file->metrics);
+    }
+    jobsmap_destroy(&file->map);
+    return 1;
+  }
+
+  // Every file gets its own events, as it would in its own process.
+  file->state = NULL;
+  if (!EMS_SHARED_STATE && (file->state = ems_state_create()) == NULL) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    close(file->out_fd);
+    if (file->metrics != NULL) {
+      metrics_destroy(file->metrics);
+    }
+    jobsmap_destroy(&file->map);
+    return 1;
+  }
+
+  file->delays = (atomic_uint *)safe_malloc((size_t)max_threads * sizeof(atomic_uint));
+  for (int i = 0; i < max_threads; i++) {
+    atomic_init(&file->delays[i], 0);
+  }
+
+  safe_mutex_init(&file->wr_out_mutex);
+  atomic_init(&file->pending, 0);
+
+  return 0;
+}
+
+/// Releases everything held by a file once its last segment has run.
+/// @param file File to be closed.
+static void close_jobs_file(struct JobsFile *file) {
+  if (close(file->out_fd) == -1) {
+    fprintf(stderr, "Failed to close .out file\n");
+  }
+
+  // Every unit of the file has finished, so no worker records into its metrics.
+  if (file->metrics != NULL) {
+    metrics_write(file->metrics);
+    metrics_destroy(file->metrics);
+  }
+
+  jobsmap_destroy(&file->map);
+  if (file->state != NULL) {
+    ems_state_destroy(file->state);
+  }
+  free(file->delays);
+  safe_mutex_destroy(&file->wr_out_mutex);
+}
+
+/// Runs a work unit, then moves its file to the next segment if it was the last
+/// unit of the current one.
+/// @param scheduler Scheduler running the unit.
+/// @param worker Worker running the unit.
+/// @param unit Unit to be run.
+static void run_unit(struct Scheduler *scheduler, int worker, struct WorkUnit *unit) {
+  struct JobsFile *file = unit->file;
+
+  struct thread_args args = {
+      .id = unit->slot,
+      .MAX_THREADS = scheduler->max_threads,
+      .jobs = NULL,
+      .jobs_map = &file->map,
+      .out_fd = file->out_fd,
+      .delays = file->delays,
+      .rd_jobs_mutex = NULL,
+      .wr_out_mutex = &file->wr_out_mutex,
+      .segment_barrier = NULL,
+      .partition = NULL,
+      .shards = NULL,
+      .metrics = file->metrics,
+  };
+
+  ems_state_attach(file->state);
+
+  // BARRIER lines end the segment and are never claimed.
+  struct Reader line;
+  while (1) {
+    wait_pending_delay(&args);
+
+    if (jobsmap_claim(&file->map, &line) != 0) {
+      break;
+    }
+    run_command(&args, &line, NULL);
+  }
+
+  if (atomic_fetch_sub(&file->pending, 1) != 1) {
+    return;
+  }
+
+  // Every unit of the segment has finished, which is what the BARRIER waits for.
+  if (jobsmap_at_barrier(&file->map)) {
+    jobsmap_next_segment(&file->map);
+    push_segment(scheduler, worker, file);
+  } else {
+    close_jobs_file(file);
+    if (atomic_fetch_sub(&scheduler->files_left, 1) == 1) {
+      wake_workers(scheduler);
+    }
+  }
+}
+
+/// Main function of the workers. Runs units from the worker's own deque and
+/// steals from the others when it is empty, until every file has finished.
+/// Workers that find no unit sleep until one is queued.
+/// @param args Arguments of the worker.
+/// @return NULL.
+static void *worker_func(void *args) {
+  struct worker_args *worker = (struct worker_args *)args;
+  struct Scheduler *scheduler = worker->scheduler;
+
+  while (atomic_load(&scheduler->files_left) > 0) {
+    struct WorkUnit unit;
+    int found = deque_take(&scheduler->deques[worker->id], &unit, 0);
+
+    for (int i = 1; !found && i < scheduler->num_workers; i++) {
+      int victim = (worker->id + i) % scheduler->num_workers;
+      found = deque_take(&scheduler->deques[victim], &unit, 1);
+    }
+
+    if (found) {
+      atomic_fetch_sub(&scheduler->queued, 1);
+      run_unit(scheduler, worker->id, &unit);
+    } else {
+      wait_for_work(scheduler);
+    }
+  }
+
+  ems_state_attach(NULL);
+  METRICS_ATTACH(NULL);
+  return NULL;
+}
+
+int schedule_jobs(const char *dir_path, char **names, size_t num_files, int num_workers,
+                  int max_threads) {
+  if (num_workers < 1 || max_threads < 1) {
+    fprintf(stderr, "Invalid number of threads\n");
+    return 1;
+  }
+
+  if (num_files == 0) {
+    return 0;
+  }
+
+  int failed = 0;
+
+  struct JobsFile *files = (struct JobsFile *)safe_malloc(num_files * sizeof(struct JobsFile));
+  size_t num_open = 0;
+  for (size_t i = 0; i < num_files; i++) {
+    if (open_jobs_file(&files[num_open], dir_path, names[i], max_threads) == 0) {
+      num_open++;
+    } else {
+      failed = 1;
+    }
+  }
+
+  struct Scheduler scheduler;
+  scheduler.num_workers = num_workers;
+  scheduler.max_threads = max_threads;
+  atomic_init(&scheduler.files_left, num_open);
+  atomic_init(&scheduler.queued, 0);
+  safe_mutex_init(&scheduler.idle_lock);
+  safe_cond_init(&scheduler.work_ready);
+  scheduler.deques = (struct Deque *)safe_malloc((size_t)num_workers * sizeof(struct Deque));
+  for (int i = 0; i < num_workers; i++) {
+    deque_init(&scheduler.deques[i]);
+  }
+
+  // The first segments are spread over the workers, stealing balances the rest.
+  for (size_t i = 0; i < num_open; i++) {
+    push_segment(&scheduler, (int)(i % (size_t)num_workers), &files[i]);
+  }
+
+  pthread_t workers[num_workers];
+  struct worker_args args[num_workers];
+
+  int num_started = 0;
+  for (; num_started < num_workers; num_started++) {
+    args[num_started].scheduler = &scheduler;
+    args[num_started].id = num_started;
+
+    if (pthread_create(&workers[num_started], NULL, worker_func, &args[num_started]) != 0) {
+      fprintf(stderr, "Failed to create thread\n");
+      failed = 1;
+      break;
+    }
+  }
+
+  // Any worker can run every unit, so the ones already started finish the work.
+  if (num_started == 0) {
+    fprintf(stderr, "No workers to run the .jobs files\n");
+    exit(1);
+  }
+
+  for (int i = 0; i < num_started; i++) {
+    if (pthread_join(workers[i], NULL) != 0) {
+      fprintf(stderr, "Failed to join thread\n");
+      failed = 1;
+    }
+  }
+
+  for (int i = 0; i < num_workers; i++) {
+    deque_destroy(&scheduler.deques[i]);
+  }
+  free(scheduler.deques);
+  safe_cond_destroy(&scheduler.work_ready);
+  safe_mutex_destroy(&scheduler.idle_lock);
+  free(files);
+
+  return failed;
+}
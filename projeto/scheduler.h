@@ -0,0 +1,22 @@
+#ifndef EMS_SCHEDULER_H
+#define EMS_SCHEDULER_H
+
+#include <stddef.h>
+
+/// Runs every .jobs file of a directory in a single pool of workers, instead of
+/// one process per file.
+/// @note Each (file, segment) pair between BARRIERs is split into one work unit
+/// per logical thread of the file, so a file never has more than max_threads
+/// units in flight and WAIT keeps its thread ids. Units go to per-worker deques
+/// and idle workers steal from the others, so small files do not wait behind a
+/// large one. Each file keeps its own events unless EMS_SHARED_STATE is set.
+/// @param dir_path Directory of the .jobs files.
+/// @param names Names of the .jobs files in the directory.
+/// @param num_files Number of names.
+/// @param num_workers Number of worker threads.
+/// @param max_threads Number of logical threads per file.
+/// @return 0 if every file was run, 1 otherwise.
+int schedule_jobs(const char *dir_path, char **names, size_t num_files, int num_workers,
+                  int max_threads);
+
+#endif // EMS_SCHEDULER_H
@@ -0,0 +1,245 @@
+#include "seatlock.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "eventlist.h"
+#include "metrics.h"
+#include "operations.h"
+#include "seatmap.h"
+
+/// Failed copies after which seatlock_snapshot stops retrying in LOCK_ATOMIC mode
+/// and holds back new reservations until it has its copy.
+#define SNAPSHOT_RETRIES 64
+
+/// Gets the lock that covers a seat.
+/// @param event Event that owns the seat.
+/// @param seat Index of the seat.
+/// @return Index of the lock.
+static size_t lock_of(struct Event *event, size_t seat) {
+  if (event->lock_mode == LOCK_ROW) {
+    return seat / event->cols;
+  }
+
+  return seat % event->num_locks;
+}
+
+size_t seatlock_count(enum LockMode mode, size_t rows, size_t cols) {
+  switch (mode) {
+  case LOCK_ROW:
+    return rows;
+  case LOCK_STRIPED:
+    return rows * cols < SEAT_LOCK_STRIPES ? rows * cols : SEAT_LOCK_STRIPES;
+  case LOCK_ATOMIC:
+  case LOCK_NONE:
+  default:
+    return 0;
+  }
+}
+
+void seatlock_init(struct Event *event, enum LockMode mode, pthread_rwlock_t *locks,
+                   int shared) {
+  event->lock_mode = mode;
+  event->num_locks = seatlock_count(mode, event->rows, event->cols);
+  event->locks = event->num_locks > 0 ? locks : NULL;
+  atomic_init(&event->writers, 0);
+  atomic_init(&event->version, 0);
+  atomic_init(&event->blocked, 0);
+
+  if (mode == LOCK_ATOMIC) {
+    if (shared) {
+      safe_mutex_init_shared(&event->gate);
+      safe_cond_init_shared(&event->gate_changed);
+    } else {
+      safe_mutex_init(&event->gate);
+      safe_cond_init(&event->gate_changed);
+    }
+  }
+
+  for (size_t i = 0; i < event->num_locks; i++) {
+    if (shared) {
+      safe_rwlock_init_shared(&event->locks[i]);
+    } else {
+      safe_rwlock_init(&event->locks[i]);
+    }
+  }
+}
+
+void seatlock_destroy(struct Event *event) {
+  if (event->lock_mode == LOCK_ATOMIC) {
+    safe_mutex_destroy(&event->gate);
+    safe_cond_destroy(&event->gate_changed);
+  }
+
+  for (size_t i = 0; i < event->num_locks; i++) {
+    safe_rwlock_destroy(&event->locks[i]);
+  }
+
+  event->locks = NULL;
+  event->num_locks = 0;
+}
+
+size_t seatlock_wrlock_all(struct Event *event, const size_t *seats,
+                           size_t num_seats, size_t *held) {
+  if (event->lock_mode == LOCK_NONE) {
+    return 0;
+  }
+
+  if (event->num_locks == 0) {
+    atomic_fetch_add(&event->writers, 1);
+
+    // A snapshot that saw writers here is waiting for them: the reservation steps
+    // back until the snapshot is done.
+    if (atomic_load(&event->blocked) != 0) {
+      safe_mutex_lock(&event->gate);
+      while (atomic_load(&event->blocked) != 0) {
+        atomic_fetch_sub(&event->writers, 1);
+        safe_cond_broadcast(&event->gate_changed);
+        safe_cond_wait(&event->gate_changed, &event->gate);
+        atomic_fetch_add(&event->writers, 1);
+      }
+      safe_mutex_unlock(&event->gate);
+    }
+    return 0;
+  }
+
+  // Locks are always taken in increasing order, which prevents deadlocks. The seats
+  // are sorted, so row locks come out in order; stripes are picked by a mark per lock.
+  size_t num_held = 0;
+  if (event->lock_mode == LOCK_ROW) {
+    for (size_t i = 0; i < num_seats; i++) {
+      size_t lock = lock_of(event, seats[i]);
+      if (num_held == 0 || held[num_held - 1] != lock) {
+        held[num_held++] = lock;
+      }
+    }
+  } else {
+    unsigned char used[SEAT_LOCK_STRIPES] = {0};
+    for (size_t i = 0; i < num_seats && num_held < event->num_locks; i++) {
+      size_t lock = lock_of(event, seats[i]);
+      if (!used[lock]) {
+        used[lock] = 1;
+        num_held++;
+      }
+    }
+
+    num_held = 0;
+    for (size_t lock = 0; lock < event->num_locks; lock++) {
+      if (used[lock]) {
+        held[num_held++] = lock;
+      }
+    }
+  }
+
+  METRICS_BEGIN(METRIC_SEAT_WR_WAIT);
+  for (size_t i = 0; i < num_held; i++) {
+    safe_rwlock_wrlock(&event->locks[held[i]]);
+  }
+  METRICS_END(METRIC_SEAT_WR_WAIT);
+  METRICS_BEGIN(METRIC_SEAT_HOLD);
+
+  return num_held;
+}
+
+void seatlock_unlock_all(struct Event *event, const size_t *held, size_t num_held) {
+  if (event->lock_mode == LOCK_NONE) {
+    return;
+  }
+
+  if (event->num_locks == 0) {
+    atomic_fetch_add(&event->version, 1);
+    atomic_fetch_sub(&event->writers, 1);
+
+    if (atomic_load(&event->blocked) != 0) {
+      safe_mutex_lock(&event->gate);
+      safe_cond_broadcast(&event->gate_changed);
+      safe_mutex_unlock(&event->gate);
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < num_held; i++) {
+    safe_rwlock_unlock(&event->locks[held[i]]);
+  }
+  METRICS_END(METRIC_SEAT_HOLD);
+}
+
+/// Copies the seats of an event, which no reservation is changing.
+/// @param event Event to be copied.
+/// @param dst Array of rows * cols entries that receives the seats.
+static void copy_seats(struct Event *event, unsigned int *dst) {
+  if (event->data == NULL) {
+    seatmap_copy(event, dst);
+    return;
+  }
+
+  size_t num_seats = event->rows * event->cols;
+  for (size_t i = 0; i < num_seats; i++) {
+    dst[i] = atomic_load_explicit(&event->data[i], memory_order_relaxed);
+  }
+}
+
+void seatlock_snapshot(struct Event *event, unsigned int *dst) {
+  size_t num_seats = event->rows * event->cols;
+
+  if (event->num_locks > 0) {
+    // Reservations hold all of their locks at once, so holding every lock gives a
+    // consistent copy. Locks are taken in increasing order, like in seatlock_wrlock_all.
+    METRICS_BEGIN(METRIC_SEAT_RD_WAIT);
+    for (size_t i = 0; i < event->num_locks; i++) {
+      safe_rwlock_rdlock(&event->locks[i]);
+    }
+    METRICS_END(METRIC_SEAT_RD_WAIT);
+    copy_seats(event, dst);
+    for (size_t i = 0; i < event->num_locks; i++) {
+      safe_rwlock_unlock(&event->locks[i]);
+    }
+    return;
+  }
+
+  // No reservation can be in progress on the thread that owns the event.
+  if (event->lock_mode == LOCK_NONE) {
+    copy_seats(event, dst);
+    return;
+  }
+
+  // The copy is only valid if no reservation was in progress while it was made.
+  for (int retries = 0; retries < SNAPSHOT_RETRIES; retries++) {
+    unsigned int version = atomic_load(&event->version);
+    if (atomic_load(&event->writers) != 0) {
+      sched_yield();
+      continue;
+    }
+
+    for (size_t i = 0; i < num_seats; i++) {
+      dst[i] = atomic_load(&event->data[i]);
+    }
+
+    if (atomic_load(&event->writers) == 0 && atomic_load(&event->version) == version) {
+      return;
+    }
+  }
+
+  // Reservations keep the event busy, possibly sleeping on each seat, so instead of
+  // spinning any longer the snapshot holds back new ones and waits for the others.
+  // Both sides raise their counter before reading the other, so either the
+  // reservation sees blocked and steps back, or the snapshot sees it in writers.
+  METRICS_BEGIN(METRIC_SEAT_RD_WAIT);
+  safe_mutex_lock(&event->gate);
+  atomic_fetch_add(&event->blocked, 1);
+  while (atomic_load(&event->writers) != 0) {
+    safe_cond_wait(&event->gate_changed, &event->gate);
+  }
+  safe_mutex_unlock(&event->gate);
+  METRICS_END(METRIC_SEAT_RD_WAIT);
+
+  copy_seats(event, dst);
+
+  safe_mutex_lock(&event->gate);
+  if (atomic_fetch_sub(&event->blocked, 1) == 1) {
+    safe_cond_broadcast(&event->gate_changed);
+  }
+  safe_mutex_unlock(&event->gate);
+}
@@ -0,0 +1,65 @@
+#ifndef EMS_SEATLOCK_H
+#define EMS_SEATLOCK_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+struct Event;
+
+/// How the seats of an event are protected.
+enum LockMode {
+  LOCK_ROW,     /// One rwlock per row.
+  LOCK_STRIPED, /// SEAT_LOCK_STRIPES rwlocks, shared by seats with the same index modulo.
+  LOCK_ATOMIC,  /// No locks, seats are claimed with compare-and-swap.
+  LOCK_NONE,    /// No locks, the seats of an event are only used by the thread that owns it.
+};
+
+/// Computes how many locks an event needs.
+/// @param mode Lock granularity.
+/// @param rows Number of rows of the event.
+/// @param cols Number of columns of the event.
+/// @return Number of locks.
+size_t seatlock_count(enum LockMode mode, size_t rows, size_t cols);
+
+/// Initializes the locks of an event.
+/// @note Uses event->rows and event->cols, which must already be set.
+/// @param event Event to be initialized.
+/// @param mode Lock granularity.
+/// @param locks Memory for seatlock_count locks, kept by the event.
+/// @param shared 1 if the locks are shared between processes, 0 otherwise.
+void seatlock_init(struct Event *event, enum LockMode mode, pthread_rwlock_t *locks,
+                   int shared);
+
+/// Destroys the locks of an event. Their memory belongs to the caller.
+/// @param event Event whose locks are destroyed.
+void seatlock_destroy(struct Event *event);
+
+/// Write-locks every lock that covers the given seats, in a global order so
+/// that concurrent callers cannot deadlock. Each lock is taken once, even if
+/// it covers several of the seats. In LOCK_ATOMIC mode no lock is taken, the
+/// reservation is only registered as in progress.
+/// @param event Event that owns the seats.
+/// @param seats Indexes of the seats, in increasing order.
+/// @param num_seats Number of seats.
+/// @param held Array of at least num_seats entries that receives the locks taken.
+/// @return Number of locks taken, to be passed to seatlock_unlock_all.
+size_t seatlock_wrlock_all(struct Event *event, const size_t *seats,
+                           size_t num_seats, size_t *held);
+
+/// Unlocks the locks taken by seatlock_wrlock_all.
+/// @param event Event that owns the locks.
+/// @param held Locks taken.
+/// @param num_held Number of locks taken.
+void seatlock_unlock_all(struct Event *event, const size_t *held, size_t num_held);
+
+/// Copies all the seats of an event in one consistent step: the copy never
+/// holds part of a reservation.
+/// @note In LOCK_ATOMIC mode the copy is retried while reservations are in
+/// progress, using the counters updated by seatlock_wrlock_all and
+/// seatlock_unlock_all. After a bounded number of retries it holds back new
+/// reservations and sleeps until the ones in progress are done.
+/// @param event Event to be copied.
+/// @param dst Array of rows * cols entries that receives the seats.
+void seatlock_snapshot(struct Event *event, unsigned int *dst);
+
+#endif // EMS_SEATLOCK_H
@@ -0,0 +1,299 @@
+#include "seatmap.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "constants.h"
+#include "eventlist.h"
+
+/// Number of bitmap words of a row. Rows never share a word, so that two
+/// threads holding different row locks never write to the same word.
+static size_t words_per_row(size_t cols) {
+  return (cols + 63) / 64;
+}
+
+/// Gets the bitmap word that holds a seat.
+static size_t word_of(const struct Event *event, size_t seat) {
+  return seat / event->cols * words_per_row(event->cols) + seat % event->cols / 64;
+}
+
+/// Gets the bit of a seat in its bitmap word.
+static uint64_t bit_of(const struct Event *event, size_t seat) {
+  return (uint64_t)1 << (seat % event->cols % 64);
+}
+
+int seatmap_is_compact(size_t rows, size_t cols) {
+  return rows * cols >= SEAT_MAP_COMPACT_MIN && cols >= SEAT_MAP_COMPACT_MIN_COLS &&
+         cols <= UINT32_MAX;
+}
+
+size_t seatmap_size(size_t rows, size_t cols) {
+  size_t bitmap_size = rows * words_per_row(cols) * sizeof(uint64_t);
+  size_t counts_size = rows * sizeof(atomic_size_t);
+  size_t seats_size = seatmap_is_compact(rows, cols) ? rows * sizeof(struct SeatRow)
+                                                     : rows * cols * sizeof(atomic_uint);
+  return bitmap_size + counts_size + (seats_size + 7) / 8 * 8;
+}
+
+void seatmap_init(struct Event *event, void *memory) {
+  size_t num_words = event->rows * words_per_row(event->cols);
+
+  event->occupied = (_Atomic uint64_t *)memory;
+  for (size_t i = 0; i < num_words; i++) {
+    atomic_init(&event->occupied[i], 0);
+  }
+
+  atomic_init(&event->reserved_seats, 0);
+  event->row_reserved = (atomic_size_t *)(void *)(event->occupied + num_words);
+  for (size_t i = 0; i < event->rows; i++) {
+    atomic_init(&event->row_reserved[i], 0);
+  }
+
+  void *seats = (void *)(event->row_reserved + event->rows);
+  if (seatmap_is_compact(event->rows, event->cols)) {
+    event->data = NULL;
+    event->seat_rows = (struct SeatRow *)seats;
+    memset(event->seat_rows, 0, event->rows * sizeof(struct SeatRow));
+  } else {
+    event->data = (atomic_uint *)seats;
+    event->seat_rows = NULL;
+    for (size_t i = 0; i < event->rows * event->cols; i++) {
+      atomic_init(&event->data[i], 0);
+    }
+  }
+}
+
+void seatmap_mark(struct Event *event, const size_t *seats, size_t num_seats) {
+  for (size_t i = 0; i < num_seats;) {
+    size_t row = seats[i] / event->cols;
+    size_t start = i;
+
+    // Rows never share a word, so the words of a row are set one after the other.
+    while (i < num_seats && seats[i] / event->cols == row) {
+      size_t word = word_of(event, seats[i]);
+      uint64_t mask = 0;
+      for (; i < num_seats && word_of(event, seats[i]) == word; i++) {
+        mask |= bit_of(event, seats[i]);
+      }
+
+      atomic_fetch_or_explicit(&event->occupied[word], mask, memory_order_relaxed);
+    }
+
+    atomic_fetch_add_explicit(&event->row_reserved[row], i - start, memory_order_relaxed);
+  }
+
+  atomic_fetch_add_explicit(&event->reserved_seats, num_seats, memory_order_relaxed);
+}
+
+/// Finds the first column of a row, from a given one, whose seat is free or
+/// reserved.
+/// @param words Bitmap words of the row.
+/// @param cols Number of columns of the row.
+/// @param from First column to look at.
+/// @param reserved 1 to look for a reserved seat, 0 for a free one.
+/// @return Column found, cols if there is none.
+static size_t next_col(_Atomic uint64_t *words, size_t cols, size_t from, int reserved) {
+  size_t num_words = words_per_row(cols);
+  size_t w = from / 64;
+  if (w >= num_words) {
+    return cols;
+  }
+
+  uint64_t word = atomic_load_explicit(&words[w], memory_order_relaxed);
+  word = (reserved ? word : ~word) & (~(uint64_t)0 << (from % 64));
+
+  while (word == 0) {
+    if (++w == num_words) {
+      return cols;
+    }
+    word = atomic_load_explicit(&words[w], memory_order_relaxed);
+    word = reserved ? word : ~word;
+  }
+
+  size_t col = w * 64 + (size_t)__builtin_ctzll(word);
+  return col < cols ? col : cols;
+}
+
+/// Finds the leftmost run of free seats of a row that is long enough.
+/// @param event Event that owns the row.
+/// @param row Index of the row.
+/// @param num_seats Number of seats needed.
+/// @param col Pointer to the variable to store the first column of the run in.
+/// @return 0 if a run was found, 1 otherwise.
+static int find_in_row(struct Event *event, size_t row, size_t num_seats, size_t *col) {
+  _Atomic uint64_t *words = event->occupied + row * words_per_row(event->cols);
+
+  // Each step jumps over a whole run of free seats and the reserved run after it.
+  size_t free_col = next_col(words, event->cols, 0, 0);
+  while (free_col < event->cols) {
+    size_t reserved_col = next_col(words, event->cols, free_col, 1);
+    if (reserved_col - free_col >= num_seats) {
+      *col = free_col;
+      return 0;
+    }
+    free_col = next_col(words, event->cols, reserved_col, 0);
+  }
+
+  return 1;
+}
+
+int seatmap_find_free(struct Event *event, size_t num_seats, size_t row_hint,
+                      size_t *first) {
+  // Rows are tried by their distance to the hinted one, the one before it first.
+  for (size_t distance = 0; distance < event->rows; distance++) {
+    size_t candidates[2] = {row_hint >= distance ? row_hint - distance : SIZE_MAX,
+                            distance > 0 ? row_hint + distance : SIZE_MAX};
+
+    for (int i = 0; i < 2; i++) {
+      size_t row = candidates[i];
+      size_t col;
+      if (row < event->rows && find_in_row(event, row, num_seats, &col) == 0) {
+        *first = row * event->cols + col;
+        return 0;
+      }
+    }
+
+    if (row_hint < distance && row_hint + distance >= event->rows) {
+      break;
+    }
+  }
+
+  return 1;
+}
+
+/// Makes room for more runs in a row.
+/// @param row Row to be grown.
+/// @param arena Arena the runs are allocated from.
+/// @param extra Number of runs that will be added.
+/// @return 0 if the runs fit, 1 on allocation failure.
+static int reserve_runs(struct SeatRow *row, struct Arena *arena, size_t extra) {
+  size_t needed = row->num_runs + extra;
+  if (needed <= row->capacity) {
+    return 0;
+  }
+
+  size_t capacity = row->capacity > 0 ? row->capacity : 4;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+  if (capacity > UINT32_MAX) {
+    return 1;
+  }
+
+  struct SeatRun *runs = arena_alloc(arena, capacity * sizeof(struct SeatRun));
+  if (runs == NULL) {
+    return 1;
+  }
+
+  if (row->num_runs > 0) {
+    memcpy(runs, row->runs, row->num_runs * sizeof(struct SeatRun));
+  }
+  arena_free(arena, row->runs, row->capacity * sizeof(struct SeatRun));
+
+  row->runs = runs;
+  row->capacity = (uint32_t)capacity;
+  return 0;
+}
+
+/// Adds the runs of a reservation to a row, keeping the runs sorted.
+/// @note The seats must be free and the row must have room for one run per
+/// group of consecutive seats.
+/// @param row Row to be modified.
+/// @param cols Number of columns of the event.
+/// @param seats Seats of the reservation in the row, in increasing order.
+/// @param num_seats Number of seats.
+/// @param num_new Number of groups of consecutive seats.
+/// @param id Reservation id.
+static void insert_runs(struct SeatRow *row, size_t cols, const size_t *seats, size_t num_seats,
+                        size_t num_new, unsigned int id) {
+  // Merges from the end, so that every run is moved at most once.
+  size_t old = row->num_runs;
+  size_t dst = old + num_new;
+  size_t i = num_seats;
+
+  while (i > 0) {
+    size_t last = seats[--i];
+    size_t first = last;
+    while (i > 0 && seats[i - 1] == first - 1) {
+      first = seats[--i];
+    }
+
+    uint32_t col = (uint32_t)(first % cols);
+    while (old > 0 && row->runs[old - 1].col > col) {
+      row->runs[--dst] = row->runs[--old];
+    }
+
+    struct SeatRun run = {col, (uint32_t)(last - first + 1), id};
+    row->runs[--dst] = run;
+  }
+
+  row->num_runs += (uint32_t)num_new;
+}
+
+int seatmap_reserve(struct Event *event, struct Arena *arena, const size_t *seats,
+                    size_t num_seats, unsigned int id) {
+  // Seats that share a bitmap word are tested together.
+  for (size_t i = 0; i < num_seats;) {
+    size_t word = word_of(event, seats[i]);
+    uint64_t mask = 0;
+    for (; i < num_seats && word_of(event, seats[i]) == word; i++) {
+      mask |= bit_of(event, seats[i]);
+    }
+
+    if ((atomic_load_explicit(&event->occupied[word], memory_order_relaxed) & mask) != 0) {
+      return 1;
+    }
+  }
+
+  // Rows are grown before any of them is changed, so that a failure leaves the
+  // event as it was.
+  for (size_t i = 0; i < num_seats;) {
+    size_t row = seats[i] / event->cols;
+    size_t num_new = 0;
+    for (size_t start = i; i < num_seats && seats[i] / event->cols == row; i++) {
+      if (i == start || seats[i] != seats[i - 1] + 1) {
+        num_new++;
+      }
+    }
+
+    if (reserve_runs(&event->seat_rows[row], arena, num_new) != 0) {
+      fprintf(stderr, "Error allocating memory for seats\n");
+      return -1;
+    }
+  }
+
+  seatmap_mark(event, seats, num_seats);
+
+  for (size_t i = 0; i < num_seats;) {
+    size_t row = seats[i] / event->cols;
+    size_t start = i;
+    size_t num_new = 0;
+    for (; i < num_seats && seats[i] / event->cols == row; i++) {
+      if (i == start || seats[i] != seats[i - 1] + 1) {
+        num_new++;
+      }
+    }
+
+    insert_runs(&event->seat_rows[row], event->cols, seats + start, i - start, num_new, id);
+  }
+
+  return 0;
+}
+
+void seatmap_copy(const struct Event *event, unsigned int *dst) {
+  memset(dst, 0, event->rows * event->cols * sizeof(unsigned int));
+
+  for (size_t row = 0; row < event->rows; row++) {
+    const struct SeatRow *seat_row = &event->seat_rows[row];
+    unsigned int *dst_row = dst + row * event->cols;
+
+    for (uint32_t r = 0; r < seat_row->num_runs; r++) {
+      const struct SeatRun *run = &seat_row->runs[r];
+      for (uint32_t c = 0; c < run->len; c++) {
+        dst_row[run->col + c] = run->id;
+      }
+    }
+  }
+}
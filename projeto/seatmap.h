@@ -0,0 +1,87 @@
+#ifndef EMS_SEATMAP_H
+#define EMS_SEATMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Arena;
+struct Event;
+
+/// Consecutive seats of a row that belong to the same reservation.
+struct SeatRun {
+  uint32_t col;    /// First column of the run, from 0.
+  uint32_t len;    /// Number of seats.
+  unsigned int id; /// Reservation id of the seats.
+};
+
+/// Reserved seats of a row of a compact seat map.
+struct SeatRow {
+  struct SeatRun *runs; /// Runs sorted by column, allocated from the arena of the event.
+  uint32_t num_runs;    /// Number of runs.
+  uint32_t capacity;    /// Number of runs that fit in runs.
+};
+
+/// Checks whether an event of the given size gets a compact seat map.
+/// @note A compact map keeps the runs of reserved seats of each row instead of
+/// one id per seat. Its rows are changed in place, so the event must be
+/// protected by row locks. Narrow events keep one id per seat, as the row lock,
+/// runs and counter of a short row take more memory than the ids they replace.
+/// @param rows Number of rows of the event.
+/// @param cols Number of columns of the event.
+/// @return 1 if the seat map is compact, 0 otherwise.
+int seatmap_is_compact(size_t rows, size_t cols);
+
+/// Computes how many bytes the seats of an event need in its block: an
+/// occupancy bitmap with one bit per seat, the number of reserved seats of each
+/// row, then one id per seat or, for a compact map, the runs of each row.
+/// @param rows Number of rows of the event.
+/// @param cols Number of columns of the event.
+/// @return Number of bytes, a multiple of 8.
+size_t seatmap_size(size_t rows, size_t cols);
+
+/// Initializes the seats of an event with every seat free.
+/// @note Uses event->rows and event->cols, which must already be set.
+/// @param event Event to be initialized.
+/// @param memory seatmap_size bytes aligned to 8, kept by the event.
+void seatmap_init(struct Event *event, void *memory);
+
+/// Sets the occupancy bits of seats that were just reserved and adds them to
+/// the reserved seat counts of the event and of their rows.
+/// @note Seats are only counted once their reservation succeeded, so a
+/// reservation that is rolled back never shows in the counts.
+/// @param event Event that owns the seats.
+/// @param seats Indexes of the seats, in increasing order.
+/// @param num_seats Number of seats.
+void seatmap_mark(struct Event *event, const size_t *seats, size_t num_seats);
+
+/// Finds consecutive free seats in a row, using the occupancy bitmap.
+/// @note Rows are tried by their distance to the hinted one and, in a row, the
+/// leftmost run of free seats that is long enough is taken. The seats are only
+/// free when they are looked at: they must still be reserved as usual.
+/// @param event Event to be searched.
+/// @param num_seats Number of seats needed.
+/// @param row_hint Index of the row to try first, from 0.
+/// @param first Pointer to the variable to store the index of the first seat in.
+/// @return 0 if the seats were found, 1 otherwise.
+int seatmap_find_free(struct Event *event, size_t num_seats, size_t row_hint, size_t *first);
+
+/// Reserves seats of an event with a compact seat map, all or none of them.
+/// @note The caller must hold the row locks of the seats. Every seat is
+/// checked with one bitmap test per word before anything is changed.
+/// @param event Event that owns the seats.
+/// @param arena Arena the event was allocated from.
+/// @param seats Distinct indexes of the seats, in increasing order.
+/// @param num_seats Number of seats.
+/// @param id Reservation id to give the seats.
+/// @return 0 if the seats were reserved, 1 if one of them is already reserved,
+/// -1 on allocation failure.
+int seatmap_reserve(struct Event *event, struct Arena *arena, const size_t *seats,
+                    size_t num_seats, unsigned int id);
+
+/// Copies the reservation id of every seat of an event.
+/// @note The caller must keep reservations out of the event during the copy.
+/// @param event Event to be copied.
+/// @param dst Array of rows * cols entries that receives the seats.
+void seatmap_copy(const struct Event *event, unsigned int *dst);
+
+#endif // EMS_SEATMAP_H
@@ -0,0 +1,156 @@
+#include "shard.h"
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "constants.h"
+#include "jobsbin.h"
+#include "parser.h"
+#include "reader.h"
+
+#define SHARD_STOP SIZE_MAX     // Queued after the last line, stops the shard
+#define IDLE_SPINS 64           // Empty polls before an idle thread starts sleeping
+#define IDLE_SLEEP_NS 100000    // Sleep of an idle thread between polls
+
+/// Waits a little before polling a ring again.
+/// @param idle Number of polls that already failed, updated.
+static void backoff(unsigned int *idle) {
+  if (*idle < IDLE_SPINS) {
+    (*idle)++;
+    sched_yield();
+  } else {
+    struct timespec delay = {0, IDLE_SLEEP_NS};
+    nanosleep(&delay, NULL);
+  }
+}
+
+/// Queues a line for a shard, waiting while its ring is full.
+/// @param ring Ring of the shard.
+/// @param line Index of the line, or SHARD_STOP.
+static void ring_push(struct ShardRing *ring, size_t line) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  unsigned int idle = 0;
+
+  while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == SHARD_RING_SIZE) {
+    backoff(&idle);
+  }
+
+  ring->lines[tail & (SHARD_RING_SIZE - 1)] = line;
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+/// Waits until every shard has run all the lines queued for it.
+/// @param shards Shards of the file.
+static void drain(struct Shards *shards) {
+  for (int i = 0; i < shards->num_shards; i++) {
+    struct ShardRing *ring = &shards->rings[i];
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int idle = 0;
+
+    while (atomic_load_explicit(&ring->head, memory_order_acquire) != tail) {
+      backoff(&idle);
+    }
+  }
+}
+
+void shards_init(struct Shards *shards, struct JobsMap *map, int num_shards) {
+  shards->map = map;
+  shards->num_shards = num_shards;
+  shards->rings = (struct ShardRing *)aligned_alloc(
+      alignof(struct ShardRing), (size_t)num_shards * sizeof(struct ShardRing));
+
+  if (shards->rings == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(1);
+  }
+
+  for (int i = 0; i < num_shards; i++) {
+    atomic_init(&shards->rings[i].head, 0);
+    atomic_init(&shards->rings[i].tail, 0);
+    shards->rings[i].lines = (size_t *)safe_malloc(SHARD_RING_SIZE * sizeof(size_t));
+  }
+}
+
+void shards_destroy(struct Shards *shards) {
+  for (int i = 0; i < shards->num_shards; i++) {
+    free(shards->rings[i].lines);
+  }
+  free(shards->rings);
+}
+
+void shards_dispatch(struct Shards *shards, struct thread_args *thread_args) {
+  struct JobsMap *map = shards->map;
+  const struct JobsDecoder *decoder = jobsbin_decoder(map);
+  size_t spread = 0;
+
+  while (1) {
+    for (size_t line = map->begin; line < map->end; line++) {
+      struct Reader reader;
+      jobsmap_line(map, line, &reader);
+
+      unsigned int event_id;
+      int has_event;
+      enum Command command = decoder->peek_command(&reader, &event_id, &has_event);
+
+      if (command == CMD_LIST_EVENTS || (command == CMD_STATS && !has_event)) {
+        // Every command before the LIST or STATS has run, so the events are the
+        // ones a single thread would see.
+        drain(shards);
+        jobsmap_line(map, line, &reader);
+        run_command(thread_args, &reader, NULL);
+      } else if (has_event) {
+        ring_push(&shards->rings[event_id % (unsigned int)shards->num_shards], line);
+      } else {
+        // Commands without an event only need to be spread out.
+        ring_push(&shards->rings[spread++ % (size_t)shards->num_shards], line);
+      }
+    }
+
+    if (!jobsmap_at_barrier(map)) {
+      break;
+    }
+
+    drain(shards);
+    jobsmap_next_segment(map);
+  }
+
+  for (int i = 0; i < shards->num_shards; i++) {
+    ring_push(&shards->rings[i], SHARD_STOP);
+  }
+}
+
+void *shard_thread_func(void *args) {
+  struct thread_args *thread_args = (struct thread_args *)args;
+  struct Shards *shards = thread_args->shards;
+  struct ShardRing *ring = &shards->rings[thread_args->id];
+  unsigned int idle = 0;
+
+  while (1) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head == atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+      backoff(&idle);
+      continue;
+    }
+    idle = 0;
+
+    size_t line = ring->lines[head & (SHARD_RING_SIZE - 1)];
+    if (line == SHARD_STOP) {
+      break;
+    }
+
+    wait_pending_delay(thread_args);
+
+    struct Reader reader;
+    jobsmap_line(shards->map, line, &reader);
+    run_command(thread_args, &reader, NULL);
+
+    // The line only counts as consumed once it has run, which is what drain waits for.
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  }
+
+  return NULL;
+}
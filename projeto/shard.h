@@ -0,0 +1,52 @@
+#ifndef EMS_SHARD_H
+#define EMS_SHARD_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "jobsmap.h"
+#include "operations.h"
+
+/// Single-producer single-consumer ring of line indexes, from the dispatcher to
+/// one shard.
+struct ShardRing {
+  alignas(64) atomic_size_t head; /// Lines the shard has finished running.
+  alignas(64) atomic_size_t tail; /// Lines the dispatcher has queued.
+  size_t *lines;
+};
+
+/// Commands of a mapped .jobs file routed by event to the threads, so that every
+/// event is only ever used by the thread that owns it.
+/// @note CREATE, RESERVE, RESERVE_BEST, SHOW and STATS of an event go to the
+/// owner of their event, the other commands are spread out. The dispatcher waits
+/// for every shard to drain before a LIST or a STATS of every event, which it
+/// runs itself, and before each BARRIER.
+struct Shards {
+  struct JobsMap *map;
+  int num_shards;
+  struct ShardRing *rings;
+};
+
+/// Prepares the shards of a mapped .jobs file.
+/// @param shards Shards to be initialized.
+/// @param map Mapped .jobs file.
+/// @param num_shards Number of threads running the file.
+void shards_init(struct Shards *shards, struct JobsMap *map, int num_shards);
+
+/// Frees the rings of the shards.
+/// @param shards Shards to be destroyed.
+void shards_destroy(struct Shards *shards);
+
+/// Routes every command of the file to the shards, until the end of the file.
+/// @param shards Shards of the file.
+/// @param thread_args Arguments used to run LIST and STATS, with the .out file.
+void shards_dispatch(struct Shards *shards, struct thread_args *thread_args);
+
+/// Main function of the threads in sharded mode. Runs the commands queued for
+/// the thread until the dispatcher stops it.
+/// @param args Arguments of the thread, with the shards.
+/// @return NULL.
+void *shard_thread_func(void *args);
+
+#endif // EMS_SHARD_H